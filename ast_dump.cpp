@@ -0,0 +1,166 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ast_format.h"
+#include "syntaxes.h"
+using namespace std;
+
+// Reads an AST written by `parser --save-ast` (see ast_format.h) straight
+// from the mapped file. By default it verifies the file and prints the tree
+// the way `parser --ast` does; --verify only checks it and prints a summary,
+// and --spans adds each statement's source span to the tree.
+
+// Prints an expression in fully parenthesized form, as dumpExpr does, with
+// a loop down the left operands since an operator chain nests as deep as
+// it is long
+void dumpExpr(const AstView &ast, uint32_t index, ostream &out)
+{
+    vector<const AstExpr *> spine;
+    const AstExpr *expr = &ast.expr(index);
+    for (; expr->kind == E_BINARY; expr = &ast.expr(expr->first))
+        spine.push_back(expr);
+    out << string(spine.size(), '(') << ast.text(*expr);
+    while (!spine.empty())
+    {
+        const AstExpr *binary = spine.back();
+        spine.pop_back();
+        out << ' ' << tokenTypeToString(TokenType(binary->op)) << ' ';
+        dumpExpr(ast, binary->second, out);
+        out << ')';
+    }
+}
+
+// Prints a statement list as dumpStmts does
+template <typename Syntax>
+void dumpStmts(const AstView &ast, uint32_t index, ostream &out, bool spans, int depth = 0)
+{
+    for (; index != AST_NONE; index = ast.stmt(index).next)
+    {
+        const AstStmt &stmt = ast.stmt(index);
+        out << string(depth * 2, ' ');
+        switch (stmt.kind)
+        {
+        case S_DECL:
+            out << Syntax::keywords.spelling(TokenType(stmt.type)) << ' ' << ast.name(AstView::symbol(stmt));
+            break;
+        case S_ASSIGN:
+            out << ast.name(AstView::symbol(stmt)) << " = ";
+            dumpExpr(ast, stmt.expr, out);
+            break;
+        case S_WHILE:
+            out << "while ";
+            dumpExpr(ast, stmt.expr, out);
+            break;
+        case S_FOR:
+        {
+            const AstStmt &init = ast.stmt(AstView::init(stmt)), &step = ast.stmt(AstView::step(stmt));
+            out << "for " << ast.name(AstView::symbol(init)) << " = ";
+            dumpExpr(ast, init.expr, out);
+            out << "; ";
+            dumpExpr(ast, stmt.expr, out);
+            out << "; " << ast.name(AstView::symbol(step)) << " = ";
+            dumpExpr(ast, step.expr, out);
+            break;
+        }
+        case S_IF:
+            out << Syntax::keywords.spelling(Syntax::ifKeyword) << ' ';
+            dumpExpr(ast, stmt.expr, out);
+            break;
+        case S_RETURN:
+        case S_PRINT:
+            out << (stmt.kind == S_RETURN ? "return " : "print ");
+            dumpExpr(ast, stmt.expr, out);
+            break;
+        case S_BREAK:
+            out << "break";
+            break;
+        case S_CONTINUE:
+            out << "continue";
+            break;
+        case S_BLOCK:
+            out << "block";
+            break;
+        }
+        if (spans && stmt.begin != AST_NONE)
+            out << "  [" << stmt.begin << ", " << stmt.end << ')';
+        out << '\n';
+        dumpStmts<Syntax>(ast, AstView::body(stmt), out, spans, depth + 1);
+        if (AstView::elseBody(stmt) != AST_NONE)
+        {
+            out << string(depth * 2, ' ') << "else\n";
+            dumpStmts<Syntax>(ast, AstView::elseBody(stmt), out, spans, depth + 1);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool verifyOnly = false;
+    bool spans = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        string_view arg = argv[i];
+        if (arg == "--verify")
+            verifyOnly = true;
+        else if (arg == "--spans")
+            spans = true;
+        else
+            path = argv[i];
+    }
+    if (path == nullptr)
+    {
+        cout << "Usage: ast_dump [--verify] [--spans] FILE" << endl;
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        cout << "Error: Unable to open file " << path << endl;
+        return 1;
+    }
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        cout << "Error: Unable to map file " << path << endl;
+        return 1;
+    }
+
+    AstView ast;
+    string error;
+    if (!ast.open(string_view(static_cast<const char *>(mapped), st.st_size), error) || !ast.verify(error))
+    {
+        cout << "Error: " << path << ": " << error << endl;
+        return 1;
+    }
+    const AstHeader &info = ast.info();
+    string_view dialect = info.dialect;
+    if (verifyOnly)
+    {
+        cout << path << ": " << dialect << ", " << info.stmtCount << " statements, " << info.exprCount
+             << " expressions, " << info.symbolCount << " symbols, " << info.literalCount << " literals, "
+             << info.stringSize << " bytes of strings; " << st.st_size << " bytes from " << info.sourceSize
+             << " bytes of source\n";
+        return 0;
+    }
+    if (dialect == AgarSyntax::name)
+        dumpStmts<AgarSyntax>(ast, ast.root(), cout, spans);
+    else if (dialect == DataTypesSyntax::name)
+        dumpStmts<DataTypesSyntax>(ast, ast.root(), cout, spans);
+    else if (dialect == LineNumberSyntax::name)
+        dumpStmts<LineNumberSyntax>(ast, ast.root(), cout, spans);
+    else
+    {
+        cout << "Error: unknown dialect " << dialect << endl;
+        return 1;
+    }
+    return 0;
+}
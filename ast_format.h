@@ -0,0 +1,546 @@
+#ifndef AST_FORMAT_H
+#define AST_FORMAT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "frontend.h"
+#include "hash.h"
+
+// A pointer-free binary form of the AST, so one process can hand a parse to
+// another without it reparsing the source. A file is an AstHeader followed
+// by four sections:
+//
+//     statements   AstStmt[stmtCount]
+//     expressions  AstExpr[exprCount]
+//     names        AstString[symbolCount + literalCount], the name of each
+//                  symbol ID, then the spelling of each distinct literal
+//     strings      the bytes of every name, back to back
+//
+// Nodes refer to other nodes by index into their section (AST_NONE for
+// none) and to names and literals by index into the names section, so a
+// reader maps the file and walks it in place through an AstView, with
+// nothing to decode. Children and successors are written before the nodes
+// that refer to them: every index in a node is below the node's own, and
+// the first top-level statement (the root) is the last statement written.
+//
+// Records are kept small, since a file holds one per node: a statement is
+// 28 bytes and an expression 12, fields that only some kinds use share a
+// slot, and nothing is stored that can be worked out from the rest. Each
+// statement records the span [begin, end) of source bytes from its first
+// name or operand to its last, bodies included; keywords and punctuation
+// around them are not. A statement with neither (an empty block) has
+// AST_NONE for both. A leaf expression records only where it starts, its
+// length being that of its name; AstView::span() works out the span of an
+// operator from its leftmost and rightmost leaves. Sources must be under
+// 4 GB.
+//
+// Everything is in native byte order. The header holds the size and XXH64
+// of the source, so a reader can tell whether the file is stale, and a
+// checksum of the sections, which verify() checks.
+
+const uint32_t AST_NONE = UINT32_MAX;
+
+struct AstString
+{
+    uint32_t offset; // in the strings section
+    uint32_t length;
+};
+
+struct AstExpr
+{
+    uint16_t kind; // ExprKind
+    uint16_t op;   // TokenType of an E_BINARY, zero in a leaf
+    // The operands of an E_BINARY. For a leaf, its offset in the source and
+    // its name: the symbol ID of an E_ID, or symbolCount plus the literal
+    // number of an E_NUM or E_BOOL.
+    uint32_t first;
+    uint32_t second;
+};
+
+struct AstStmt
+{
+    uint16_t kind; // StmtKind
+    uint16_t type; // TokenType, the type keyword of an S_DECL
+    uint32_t begin;
+    uint32_t end;
+    uint32_t expr;
+    // The symbol ID of the variable an S_DECL or S_ASSIGN declares or
+    // assigns; for any other kind, the first statement of its body
+    uint32_t child;
+    // The else branch of an S_IF, or the initializer of an S_FOR, whose
+    // step is always the statement right after it
+    uint32_t branch;
+    uint32_t next;
+};
+
+struct AstHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t root;    // first top-level statement, or AST_NONE
+    char dialect[16]; // Syntax::name of the front end, NUL-padded
+    uint64_t sourceSize;
+    uint64_t sourceHash; // XXH64 of the source
+    uint32_t stmtCount;
+    uint32_t exprCount;
+    uint32_t symbolCount;
+    uint32_t literalCount;
+    uint32_t stringSize;
+    uint32_t reserved; // zero
+    uint64_t checksum;
+};
+
+// Records are multiples of 4 bytes with no padding inside, so every section
+// stays 4-byte aligned
+static_assert(sizeof(AstStmt) == 28 && sizeof(AstExpr) == 12 && sizeof(AstHeader) % 8 == 0,
+              "AST file layout changed");
+
+constexpr char AST_MAGIC[8] = {'A', 'G', 'A', 'R', 'A', 'S', 'T', '\0'};
+const uint32_t AST_VERSION = 2;
+
+// XXH64 of each section in turn, each seeded with the hash of the ones
+// before, so the writer can hash the sections where they lie
+inline uint64_t astChecksum(std::initializer_list<std::string_view> sections)
+{
+    uint64_t hash = 0;
+    for (std::string_view section : sections)
+        hash = hashBytes(section, hash);
+    return hash;
+}
+
+// Serializes a parsed program in one walk over the tree. Expressions and
+// statement lists are walked on explicit stacks, since an operator chain
+// nests as deep as it is long. The sections are built in memory and then
+// written out from where they are.
+class AstWriter
+{
+private:
+    struct Pending
+    {
+        const void *node; // an Expr or a Stmt, null for a missing child
+        bool expanded;    // children done, node itself next
+    };
+    AstHeader header;
+    std::string_view src;
+    std::vector<AstStmt> stmts;
+    std::vector<AstExpr> exprs;
+    std::vector<AstString> names; // symbols by ID, then literals
+    std::string strings;
+    std::unordered_map<std::string_view, uint32_t> literals; // indices in names
+    std::vector<Pending> pending, pendingExprs;
+    std::vector<uint32_t> results; // indices of finished children
+    // Span of each expression, and of a statement and the ones after it in
+    // its list; the file keeps neither
+    std::vector<uint32_t> exprBegin, exprEnd, listBegin, listEnd;
+    bool ok;
+
+    uint32_t name(std::string_view text)
+    {
+        names.push_back(AstString{uint32_t(strings.size()), uint32_t(text.size())});
+        strings += text;
+        return uint32_t(names.size() - 1);
+    }
+    uint32_t literal(std::string_view text)
+    {
+        auto found = literals.find(text);
+        if (found != literals.end())
+            return found->second;
+        return literals[text] = name(text);
+    }
+    // Offset of text in the source; ASTs over other buffers (such as an
+    // IncrementalDocument's segments) cannot be written
+    uint32_t offsetOf(std::string_view text)
+    {
+        uintptr_t p = reinterpret_cast<uintptr_t>(text.data()), base = reinterpret_cast<uintptr_t>(src.data());
+        if (p < base || p + text.size() > base + src.size())
+        {
+            ok = false;
+            return 0;
+        }
+        return uint32_t(p - base);
+    }
+    uint32_t popResult()
+    {
+        uint32_t index = results.back();
+        results.pop_back();
+        return index;
+    }
+    uint32_t addExpr(const Expr *root)
+    {
+        pendingExprs.push_back(Pending{root, false});
+        while (!pendingExprs.empty())
+        {
+            Pending item = pendingExprs.back();
+            pendingExprs.pop_back();
+            const Expr *expr = static_cast<const Expr *>(item.node);
+            if (expr->kind == E_BINARY && !item.expanded)
+            {
+                pendingExprs.push_back(Pending{expr, true});
+                pendingExprs.push_back(Pending{expr->rhs, false});
+                pendingExprs.push_back(Pending{expr->lhs, false});
+                continue;
+            }
+            AstExpr node = {};
+            node.kind = expr->kind;
+            if (expr->kind == E_BINARY)
+            {
+                node.op = expr->op;
+                node.second = popResult();
+                node.first = popResult();
+                exprBegin.push_back(exprBegin[node.first]);
+                exprEnd.push_back(exprEnd[node.second]);
+            }
+            else
+            {
+                node.first = offsetOf(expr->text);
+                node.second = expr->kind == E_ID ? expr->symbol : literal(expr->text);
+                exprBegin.push_back(node.first);
+                exprEnd.push_back(node.first + uint32_t(expr->text.size()));
+            }
+            results.push_back(uint32_t(exprs.size()));
+            exprs.push_back(node);
+        }
+        return popResult();
+    }
+    // Widens a statement's span, kept as begin > end while it is empty
+    static void widen(AstStmt &node, uint32_t begin, uint32_t end)
+    {
+        if (begin <= end)
+        {
+            node.begin = std::min(node.begin, begin);
+            node.end = std::max(node.end, end);
+        }
+    }
+    void widenByList(AstStmt &node, uint32_t first)
+    {
+        if (first != AST_NONE)
+            widen(node, listBegin[first], listEnd[first]);
+    }
+    // Adds the list starting at first and returns its first statement's
+    // index, or AST_NONE if the list is empty
+    uint32_t addList(const Stmt *first)
+    {
+        pending.push_back(Pending{first, false});
+        while (!pending.empty())
+        {
+            Pending item = pending.back();
+            pending.pop_back();
+            const Stmt *stmt = static_cast<const Stmt *>(item.node);
+            if (stmt == nullptr)
+            {
+                results.push_back(AST_NONE);
+                continue;
+            }
+            if (!item.expanded)
+            {
+                // Popped in the reverse order of these pushes, so the
+                // results come back as body, elseBody, init, step, next
+                pending.push_back(Pending{stmt, true});
+                pending.push_back(Pending{stmt->next, false});
+                pending.push_back(Pending{stmt->step, false});
+                pending.push_back(Pending{stmt->init, false});
+                pending.push_back(Pending{stmt->elseBody, false});
+                pending.push_back(Pending{stmt->body, false});
+                continue;
+            }
+            AstStmt node = {};
+            node.kind = stmt->kind;
+            node.type = stmt->type;
+            node.begin = AST_NONE;
+            node.end = 0;
+            node.next = popResult();
+            uint32_t step = popResult();
+            uint32_t init = popResult();
+            uint32_t elseBody = popResult();
+            uint32_t body = popResult();
+            // The stack finishes init just before step, so step is init + 1
+            node.child = stmt->kind == S_DECL || stmt->kind == S_ASSIGN ? stmt->symbol : body;
+            node.branch = stmt->kind == S_FOR ? init : elseBody;
+            node.expr = AST_NONE;
+            if (!stmt->name.empty())
+            {
+                uint32_t offset = offsetOf(stmt->name);
+                widen(node, offset, offset + uint32_t(stmt->name.size()));
+            }
+            if (stmt->expr != nullptr)
+            {
+                node.expr = addExpr(stmt->expr);
+                widen(node, exprBegin[node.expr], exprEnd[node.expr]);
+            }
+            widenByList(node, init);
+            widenByList(node, step);
+            widenByList(node, body);
+            widenByList(node, elseBody);
+            uint32_t index = uint32_t(stmts.size());
+            listBegin.push_back(node.begin);
+            listEnd.push_back(node.end);
+            if (node.next != AST_NONE && listBegin[node.next] <= listEnd[node.next])
+            {
+                listBegin[index] = std::min(node.begin, listBegin[node.next]);
+                listEnd[index] = std::max(node.end, listEnd[node.next]);
+            }
+            if (node.begin > node.end)
+                node.begin = node.end = AST_NONE;
+            results.push_back(index);
+            stmts.push_back(node);
+        }
+        return popResult();
+    }
+    template <typename T>
+    static std::string_view bytesOf(const std::vector<T> &values)
+    {
+        return std::string_view(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+    }
+
+public:
+    // Serializes program, parsed from src by the front end named `dialect`
+    // with names interned in symbols. Returns false if the tree is too big
+    // for the format or does not point into src.
+    bool build(const char *dialect, std::string_view src, const Stmt *program, const SymbolPool &symbols)
+    {
+        this->src = src;
+        ok = src.size() < UINT32_MAX && strlen(dialect) < sizeof(header.dialect);
+        if (!ok)
+            return false;
+        stmts.clear();
+        exprs.clear();
+        names.clear();
+        strings.clear();
+        literals.clear();
+        exprBegin.clear();
+        exprEnd.clear();
+        listBegin.clear();
+        listEnd.clear();
+        for (size_t id = 0; id < symbols.size(); id++)
+            name(symbols.name(id));
+        uint32_t root = addList(program);
+        if (!ok || stmts.size() >= AST_NONE || exprs.size() >= AST_NONE || strings.size() >= UINT32_MAX)
+            return false;
+
+        header = {};
+        memcpy(header.magic, AST_MAGIC, sizeof(AST_MAGIC));
+        header.version = AST_VERSION;
+        header.root = root;
+        memcpy(header.dialect, dialect, strlen(dialect)); // checked to leave a NUL
+        header.sourceSize = src.size();
+        header.sourceHash = hashBytes(src);
+        header.stmtCount = uint32_t(stmts.size());
+        header.exprCount = uint32_t(exprs.size());
+        header.symbolCount = uint32_t(symbols.size());
+        header.literalCount = uint32_t(literals.size());
+        header.stringSize = uint32_t(strings.size());
+        header.checksum = astChecksum({bytesOf(stmts), bytesOf(exprs), bytesOf(names), strings});
+        return true;
+    }
+    // Writes what the last successful build() produced
+    void write(std::ostream &out) const
+    {
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (std::string_view section : {bytesOf(stmts), bytesOf(exprs), bytesOf(names), std::string_view(strings)})
+            out.write(section.data(), section.size());
+    }
+};
+
+// Read-only access to a serialized AST in place, typically an mmapped
+// file. open() checks only the header, so it costs nothing like the size
+// of the file; call verify() before walking a file that may be damaged or
+// not written by AstWriter, after which every index, name and span in it is
+// known to be in range. The statement accessors below sort out which of a
+// record's shared slots holds what.
+class AstView
+{
+private:
+    const AstHeader *header;
+    const AstStmt *stmts;
+    const AstExpr *exprs;
+    const AstString *names;
+    const char *strings;
+
+    // The fields a statement of each kind has as the parser builds it:
+    // which it must have (expr; init and step; a symbol) and which it may
+    struct Shape
+    {
+        bool expr, forParts, symbol, body, elseBody;
+    };
+    static Shape shapeOf(uint16_t kind)
+    {
+        switch (kind)
+        {
+        case S_DECL:
+            return Shape{false, false, true, false, false};
+        case S_ASSIGN:
+            return Shape{true, false, true, false, false};
+        case S_WHILE:
+            return Shape{true, false, false, true, false};
+        case S_FOR:
+            return Shape{true, true, false, true, false};
+        case S_IF:
+            return Shape{true, false, false, true, true};
+        case S_RETURN:
+        case S_PRINT:
+            return Shape{true, false, false, false, false};
+        default:
+            return Shape{false, false, false, kind == S_BLOCK, false};
+        }
+    }
+    uint64_t nameCount() const { return uint64_t(header->symbolCount) + header->literalCount; }
+    bool validSpan(uint32_t begin, uint32_t end) const
+    {
+        return begin == AST_NONE ? end == AST_NONE : begin <= end && end <= header->sourceSize;
+    }
+    template <typename T>
+    static std::string_view bytesOf(const T *values, size_t count)
+    {
+        return std::string_view(reinterpret_cast<const char *>(values), count * sizeof(T));
+    }
+
+public:
+    AstView() : header(nullptr), stmts(nullptr), exprs(nullptr), names(nullptr), strings(nullptr) {}
+
+    // Checks the header of the serialized AST in bytes, which must stay
+    // mapped while the view is used and start 8-byte aligned
+    bool open(std::string_view bytes, std::string &error)
+    {
+        header = reinterpret_cast<const AstHeader *>(bytes.data());
+        if (reinterpret_cast<uintptr_t>(bytes.data()) % 8 != 0)
+            error = "buffer is not 8-byte aligned";
+        else if (bytes.size() < sizeof(AstHeader) || memcmp(header->magic, AST_MAGIC, sizeof(AST_MAGIC)) != 0)
+            error = "not a serialized AST";
+        else if (header->version != AST_VERSION)
+            error = "unsupported version " + std::to_string(header->version);
+        else if (bytes.size() != sizeof(AstHeader) + uint64_t(header->stmtCount) * sizeof(AstStmt) +
+                                     uint64_t(header->exprCount) * sizeof(AstExpr) +
+                                     nameCount() * sizeof(AstString) + header->stringSize)
+            error = "file size does not match the header";
+        else if (header->root != AST_NONE && header->root >= header->stmtCount)
+            error = "root out of range";
+        else if (memchr(header->dialect, '\0', sizeof(header->dialect)) == nullptr)
+            error = "dialect name is not terminated";
+        else
+        {
+            stmts = reinterpret_cast<const AstStmt *>(bytes.data() + sizeof(AstHeader));
+            exprs = reinterpret_cast<const AstExpr *>(stmts + header->stmtCount);
+            names = reinterpret_cast<const AstString *>(exprs + header->exprCount);
+            strings = reinterpret_cast<const char *>(names + nameCount());
+            return true;
+        }
+        header = nullptr;
+        return false;
+    }
+    // Checks the checksum and every node: kinds, operators and fields as
+    // the parser produces them, indices below the node's own and each node
+    // referenced at most once (so the nodes form a tree), and names,
+    // strings and spans in range
+    bool verify(std::string &error) const
+    {
+        if (astChecksum({bytesOf(stmts, header->stmtCount), bytesOf(exprs, header->exprCount),
+                         bytesOf(names, nameCount()), bytesOf(strings, header->stringSize)}) != header->checksum)
+        {
+            error = "checksum mismatch";
+            return false;
+        }
+        for (uint64_t id = 0; id < nameCount(); id++)
+            if (uint64_t(names[id].offset) + names[id].length > header->stringSize)
+            {
+                error = "name " + std::to_string(id) + " out of range";
+                return false;
+            }
+        std::vector<bool> usedExprs(header->exprCount), usedStmts(header->stmtCount);
+        auto claim = [](std::vector<bool> &used, uint32_t child, uint32_t parent)
+        {
+            if (child == AST_NONE)
+                return true;
+            if (child >= parent || used[child])
+                return false;
+            used[child] = true;
+            return true;
+        };
+        for (uint32_t i = 0; i < header->exprCount; i++)
+        {
+            const AstExpr &node = exprs[i];
+            bool valid;
+            if (node.kind == E_BINARY)
+                valid = binaryOperators.of(TokenType(node.op)).precedence != 0 && node.first != AST_NONE &&
+                        node.second != AST_NONE && claim(usedExprs, node.first, i) &&
+                        claim(usedExprs, node.second, i);
+            else
+                valid = node.kind < E_BINARY && node.op == 0 &&
+                        (node.kind == E_ID ? node.second < header->symbolCount
+                                           : node.second >= header->symbolCount && node.second < nameCount()) &&
+                        uint64_t(node.first) + names[node.second].length <= header->sourceSize;
+            if (!valid)
+            {
+                error = "expression " + std::to_string(i) + " is malformed";
+                return false;
+            }
+        }
+        for (uint32_t i = 0; i < header->stmtCount; i++)
+        {
+            const AstStmt &node = stmts[i];
+            Shape shape = shapeOf(node.kind);
+            bool valid = node.kind <= S_BLOCK && validSpan(node.begin, node.end) &&
+                         (node.expr != AST_NONE) == shape.expr &&
+                         (shape.symbol ? node.child < header->symbolCount
+                                       : (shape.body || node.child == AST_NONE) && claim(usedStmts, node.child, i)) &&
+                         (shape.forParts ? node.branch != AST_NONE && claim(usedStmts, node.branch, i) &&
+                                               claim(usedStmts, node.branch + 1, i)
+                                         : (shape.elseBody || node.branch == AST_NONE) &&
+                                               claim(usedStmts, node.branch, i)) &&
+                         claim(usedExprs, node.expr, header->exprCount) && claim(usedStmts, node.next, i);
+            // The parts of a for loop are lone assignments, not lists
+            for (uint32_t part : {init(node), step(node)})
+                if (valid && part != AST_NONE)
+                    valid = stmts[part].kind == S_ASSIGN && stmts[part].next == AST_NONE;
+            if (!valid)
+            {
+                error = "statement " + std::to_string(i) + " is malformed";
+                return false;
+            }
+        }
+        if (header->root != AST_NONE && usedStmts[header->root])
+        {
+            error = "root is also a child";
+            return false;
+        }
+        return true;
+    }
+
+    const AstHeader &info() const { return *header; }
+    uint32_t root() const { return header->root; }
+    const AstStmt &stmt(uint32_t index) const { return stmts[index]; }
+    const AstExpr &expr(uint32_t index) const { return exprs[index]; }
+    std::string_view name(uint32_t id) const { return std::string_view(strings + names[id].offset, names[id].length); }
+
+    // The fields of a statement, AST_NONE where its kind has none
+    static uint32_t symbol(const AstStmt &stmt) { return shapeOf(stmt.kind).symbol ? stmt.child : AST_NONE; }
+    static uint32_t body(const AstStmt &stmt) { return shapeOf(stmt.kind).symbol ? AST_NONE : stmt.child; }
+    static uint32_t elseBody(const AstStmt &stmt) { return stmt.kind == S_IF ? stmt.branch : AST_NONE; }
+    static uint32_t init(const AstStmt &stmt) { return stmt.kind == S_FOR ? stmt.branch : AST_NONE; }
+    static uint32_t step(const AstStmt &stmt) { return stmt.kind == S_FOR ? stmt.branch + 1 : AST_NONE; }
+
+    // Spelling of an E_NUM, E_ID or E_BOOL
+    std::string_view text(const AstExpr &expr) const { return name(expr.second); }
+    // Source span of an expression, from the start of its leftmost leaf to
+    // the end of its rightmost
+    std::pair<uint32_t, uint32_t> span(const AstExpr &expr) const
+    {
+        const AstExpr *left = &expr, *right = &expr;
+        while (left->kind == E_BINARY)
+            left = &exprs[left->first];
+        while (right->kind == E_BINARY)
+            right = &exprs[right->second];
+        return {left->first, right->first + names[right->second].length};
+    }
+};
+
+#endif
@@ -0,0 +1,556 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "char_scan.h"
+#include "keywords.h"
+
+// Benchmark support shared by the parser.cpp, data_types.cpp and
+// line_number.cpp drivers: a seeded generator of valid programs in each
+// dialect, helpers to time and report the lexing and parsing phases, and a
+// check that no adversarial input makes a front end superlinear.
+
+// The grammar a front end accepts, as far as the generator needs to know it
+struct Dialect
+{
+    const char *name;
+    std::vector<std::string_view> types;       // declaration keywords
+    std::string_view ifKeyword;
+    std::vector<std::string_view> operators;   // arithmetic operators
+    std::vector<std::string_view> comparisons; // allowed in conditions
+    bool loops;    // while, for, print, break and continue
+    bool decimals; // numbers may have a fractional part
+    std::vector<std::string_view> logical; // join comparisons in conditions
+    // For a front end that type-checks: v0 .. v999 are declared up front
+    // with these types, and declarations after that use fresh names
+    std::vector<std::string_view> variableTypes = {};
+};
+
+struct BenchOptions
+{
+    uint64_t seed = 1;
+    size_t bytes = 1 << 20; // size of the generated program
+    unsigned depth = 3;     // deepest nesting of compound statements
+    unsigned ids = 60;      // percentage of operands that are identifiers
+    unsigned expr = 4;      // average number of operands in an expression
+    unsigned repeat = 5;    // each phase is timed this many times, best kept
+    bool emit = false;      // print the program instead of timing it
+    bool words = false;     // name variables like count or index7, not v0 .. v999
+};
+
+// Reads the benchmark option at argv[i] (and its value), returning false if
+// argv[i] is not one. Sizes take a K, M or G suffix.
+inline bool parseBenchOption(int argc, char *argv[], int &i, BenchOptions &options)
+{
+    std::string_view arg = argv[i];
+    if (arg == "--emit" || arg == "--words")
+    {
+        (arg == "--emit" ? options.emit : options.words) = true;
+        return true;
+    }
+    if (i + 1 >= argc)
+        return false;
+    char *suffix;
+    unsigned long long value = strtoull(argv[i + 1], &suffix, 10);
+    if (arg == "--size")
+    {
+        switch (*suffix)
+        {
+        case 'G': case 'g': value <<= 10; [[fallthrough]];
+        case 'M': case 'm': value <<= 10; [[fallthrough]];
+        case 'K': case 'k': value <<= 10;
+        }
+        options.bytes = value;
+    }
+    else if (arg == "--seed")
+        options.seed = value;
+    else if (arg == "--depth")
+        options.depth = value;
+    else if (arg == "--ids")
+        options.ids = std::min(value, 100ull);
+    else if (arg == "--expr")
+        options.expr = std::max(value, 1ull);
+    else if (arg == "--repeat")
+        options.repeat = std::max(value, 1ull);
+    else
+        return false;
+    i++;
+    return true;
+}
+
+// Generates a random but valid program of about options.bytes bytes. The
+// same dialect, options and seed always give the same program.
+class ProgramGenerator
+{
+private:
+    static const unsigned NAMES = 1000; // distinct identifiers v0 .. v999
+    // Names for --words, none a keyword in any dialect. Several share their
+    // length and first and last letters with a keyword (first and float,
+    // write and while, region and return, tree and true), which the keyword
+    // table's hash cannot tell apart without comparing the text.
+    static constexpr const char *WORDS[] = {
+        "count", "index", "value", "total", "result", "item",  "sum",    "temp",   "node",     "left",
+        "right", "size",  "width", "height", "offset", "line", "start",  "step",   "limit",    "key",
+        "data",  "input", "output", "state", "buffer", "name", "length", "found",  "error",    "first",
+        "write", "region", "divide", "spring", "edge",  "tree", "frame",  "point",  "complete", "bell"};
+    const Dialect &dialect;
+    BenchOptions options;
+    uint64_t state;
+    uint64_t fresh; // fresh names declared so far
+    std::string out;
+
+    uint64_t next() // splitmix64
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    size_t below(size_t n) { return next() % n; }
+    bool chance(unsigned percent) { return below(100) < percent; }
+    template <typename T>
+    const T &pick(const std::vector<T> &choices) { return choices[below(choices.size())]; }
+
+    void number(uint64_t value)
+    {
+        char digits[20];
+        size_t n = 0;
+        do
+            digits[n++] = char('0' + value % 10);
+        while (value /= 10);
+        while (n > 0)
+            out += digits[--n];
+    }
+    void name() { name(below(NAMES)); }
+    void name(uint64_t index)
+    {
+        if (!options.words)
+        {
+            out += 'v';
+            number(index);
+            return;
+        }
+        const size_t words = std::size(WORDS);
+        out += WORDS[index % words];
+        if (index >= words)
+            number(index / words);
+    }
+    void operand(unsigned nesting)
+    {
+        if (nesting > 0 && chance(10))
+        {
+            out += '(';
+            expression(nesting - 1);
+            out += ')';
+        }
+        else if (chance(options.ids))
+            name();
+        else
+        {
+            number(below(1000));
+            if (dialect.decimals && chance(25))
+            {
+                out += '.';
+                number(below(100));
+            }
+        }
+    }
+    void expression(unsigned nesting = 2)
+    {
+        size_t operands = 1 + below(2 * options.expr - 1);
+        operand(nesting);
+        for (size_t i = 1; i < operands; i++)
+        {
+            out += ' ';
+            out += pick(dialect.operators);
+            out += ' ';
+            operand(nesting);
+        }
+    }
+    void comparison()
+    {
+        expression();
+        out += ' ';
+        out += pick(dialect.comparisons);
+        out += ' ';
+        expression();
+    }
+    void condition()
+    {
+        comparison();
+        while (!dialect.logical.empty() && chance(25))
+        {
+            out += ' ';
+            out += pick(dialect.logical);
+            out += ' ';
+            comparison();
+        }
+    }
+    void assignment()
+    {
+        name();
+        out += " = ";
+        expression();
+    }
+    void block(unsigned level, bool inLoop)
+    {
+        out += "{\n";
+        for (size_t i = 1 + below(4); i > 0; i--)
+            statement(level + 1, inLoop);
+        out.append(level * 4, ' ');
+        out += '}';
+    }
+    void statement(unsigned level, bool inLoop)
+    {
+        out.append(level * 4, ' ');
+        // Compound statements only while below the nesting limit
+        unsigned roll = below(level < options.depth ? 100 : 70);
+        if (roll < 15)
+        {
+            out += pick(dialect.types);
+            out += ' ';
+            if (dialect.variableTypes.empty())
+                name();
+            else
+            {
+                out += 'u';
+                number(fresh++);
+            }
+            out += ';';
+        }
+        else if (roll < 50)
+        {
+            assignment();
+            out += ';';
+        }
+        else if (roll < 60)
+        {
+            out += "return ";
+            expression();
+            out += ';';
+        }
+        else if (roll < 70 && dialect.loops)
+        {
+            if (inLoop && chance(30))
+                out += chance(50) ? "break;" : "continue;";
+            else
+            {
+                out += "print(";
+                expression();
+                out += ");";
+            }
+        }
+        else if (roll < 70)
+        {
+            assignment();
+            out += ';';
+        }
+        else if (roll < 82)
+        {
+            out += dialect.ifKeyword;
+            out += " (";
+            condition();
+            out += ") ";
+            block(level, inLoop);
+            if (chance(40))
+            {
+                out += " else ";
+                block(level, inLoop);
+            }
+        }
+        else if (roll < 94 && dialect.loops)
+        {
+            if (chance(50))
+            {
+                out += "while (";
+                condition();
+            }
+            else
+            {
+                out += "for (";
+                assignment();
+                out += "; ";
+                condition();
+                out += "; ";
+                assignment();
+            }
+            out += ") ";
+            block(level, true);
+        }
+        else
+            block(level, inLoop);
+        out += '\n';
+    }
+
+public:
+    ProgramGenerator(const Dialect &dialect, const BenchOptions &options)
+        : dialect(dialect), options(options), state(options.seed), fresh(0) {}
+
+    std::string generate()
+    {
+        out.clear();
+        out.reserve(options.bytes + 4096);
+        fresh = 0;
+        if (!dialect.variableTypes.empty())
+        {
+            for (unsigned i = 0; i < NAMES; i++)
+            {
+                out += pick(dialect.variableTypes);
+                out += ' ';
+                name(i);
+                out += ";\n";
+            }
+        }
+        while (out.size() < options.bytes)
+            statement(0, false);
+        return std::move(out);
+    }
+};
+
+// Runs f `repeat` times and returns the fastest run in seconds
+template <typename F>
+double bestTime(unsigned repeat, F f)
+{
+    double best = 0;
+    for (unsigned i = 0; i < repeat; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = i == 0 ? seconds : std::min(best, seconds);
+    }
+    return best;
+}
+
+inline void printBenchHeader(std::ostream &out, const Dialect &dialect, const BenchOptions &options,
+                             size_t bytes, size_t tokens)
+{
+    out << dialect.name << ": " << bytes << " bytes, " << tokens << " tokens (seed " << options.seed
+        << ", depth " << options.depth << ", ids " << options.ids << "%" << (options.words ? " words" : "")
+        << ", expr " << options.expr << "), best of " << options.repeat << '\n';
+}
+
+// Prints one phase as "<phase>  <ms>  <MB/s>  <Mtokens/s>"
+inline void printBenchPhase(std::ostream &out, const char *phase, size_t bytes, size_t tokens, double seconds)
+{
+    out << std::left << std::setw(8) << phase << std::right << std::fixed << std::setprecision(2)
+        << std::setw(10) << seconds * 1e3 << " ms" << std::setw(10) << bytes / 1e6 / seconds << " MB/s"
+        << std::setw(10) << tokens / 1e6 / seconds << " Mtokens/s\n"
+        << std::defaultfloat;
+}
+
+// Times classifying every word of src as a keyword or an identifier, once
+// through table and once comparing the word with each keyword in turn, as
+// the lexers did before KeywordTable, and prints both as phases counting
+// words as tokens. Run with --ids 100 --words for identifier-heavy input.
+template <typename Type, size_t N>
+void benchKeywords(std::ostream &out, std::string_view src, const Keyword<Type> (&keywords)[N],
+                   const KeywordTable<Type, N> &table, Type identifier, unsigned repeat)
+{
+    // Split the source into words as the lexer does, with its character
+    // classes and scanners: a word starts with a letter and runs on through
+    // letters and digits, and a run of digits is a number, not a word
+    const CharScanner &scan = charScanner();
+    std::vector<std::string_view> words;
+    const char *end = src.data() + src.size();
+    for (const char *p = src.data(); p < end;)
+    {
+        if (isAlphaChar(*p))
+        {
+            const char *start = p;
+            p = scan.skipAlnum(p, end);
+            words.push_back(std::string_view(start, p - start));
+        }
+        else if (isDigitChar(*p))
+            p = scan.skipDigits(p, end);
+        else
+            p++;
+    }
+    volatile size_t sink;
+    double chainTime = bestTime(repeat, [&]
+                                {
+        size_t found = 0;
+        for (std::string_view word : words)
+            for (const Keyword<Type> &keyword : keywords)
+                if (word == keyword.text)
+                {
+                    found++;
+                    break;
+                }
+        sink = found; });
+    double tableTime = bestTime(repeat, [&]
+                                {
+        size_t found = 0;
+        for (std::string_view word : words)
+            found += table.lookup(word, identifier) != identifier;
+        sink = found; });
+    (void)sink;
+    printBenchPhase(out, "kw-chain", src.size(), words.size(), chainTime);
+    printBenchPhase(out, "kw-table", src.size(), words.size(), tableTime);
+}
+
+// Inputs built to hit a front end's worst cases rather than to look like
+// programs: one construct repeated until the input is `bytes` long. Most
+// are invalid, some on purpose on every line, since error paths are where
+// per-diagnostic costs (finding a line number, flushing output) add up.
+const char *const adversarialShapes[] = {
+    "nested blocks",   // {{{ ... }}}
+    "nested parens",   // v0 = ((( ... 1 ... )));
+    "long identifier", // one name of `bytes` characters
+    "operator chain",  // v0 = 1 + 1 + ... + 1;
+    "operator run",    // v0 = + + + ...   (one error, then recovery)
+    "huge number",     // v0 = 999 ... 9;
+    "unknown chars",   // @@@ ...   (one error per character)
+    "error per line",  // v0 = ; on every line
+};
+
+inline std::string adversarialInput(const Dialect &dialect, size_t shape, size_t bytes)
+{
+    std::string out;
+    out.reserve(bytes + 64);
+    std::string declare = std::string(dialect.types[0]) + " v0;\n";
+    std::string_view plus = dialect.operators[0];
+    switch (shape)
+    {
+    case 0:
+        out.append(bytes / 2, '{');
+        out.append(bytes / 2, '}');
+        break;
+    case 1:
+        out = declare + "v0 = ";
+        out.append(bytes / 2, '(');
+        out += '1';
+        out.append(bytes / 2, ')');
+        out += ";\n";
+        break;
+    case 2:
+        out = std::string(dialect.types[0]) + " v";
+        out.append(bytes, 'x');
+        out += ";\n";
+        break;
+    case 3:
+        out = declare + "v0 = 1";
+        while (out.size() < bytes)
+            out.append(" ").append(plus).append(" 1");
+        out += ";\n";
+        break;
+    case 4:
+        out = declare + "v0 = ";
+        while (out.size() < bytes)
+            out.append(plus).append(" ");
+        break;
+    case 5:
+        out = declare + "v0 = ";
+        out.append(bytes, '9');
+        out += ";\n";
+        break;
+    case 6:
+        while (out.size() < bytes)
+            out.append(63, '@').append("\n");
+        break;
+    default:
+        out = declare;
+        while (out.size() < bytes)
+            out += "v0 = ;\n";
+        break;
+    }
+    return out;
+}
+
+// An ostream that throws away whatever is printed to it, so a check can
+// time printing without also timing a growing buffer's allocations
+class DiscardStream : public std::ostream
+{
+private:
+    struct Buffer : std::streambuf
+    {
+        int overflow(int c) override { return traits_type::not_eof(c); }
+        std::streamsize xsputn(const char *, std::streamsize count) override { return count; }
+    };
+    Buffer buffer;
+
+public:
+    DiscardStream() : std::ostream(&buffer) {}
+};
+
+// Least-squares slope of log time against log size, for times measured at
+// sizes doubling from one step to the next. Below a microsecond or so,
+// timer resolution is all that is measured.
+inline double growthExponent(const double *times, size_t steps)
+{
+    double sumX = 0, sumY = 0, sumXY = 0, sumXX = 0;
+    for (size_t step = 0; step < steps; step++)
+    {
+        double x = double(step), y = std::log2(std::max(times[step], 1e-6));
+        sumX += x;
+        sumY += y;
+        sumXY += x * y;
+        sumXX += x * x;
+    }
+    return (steps * sumXY - sumX * sumY) / (steps * sumXX - sumX * sumX);
+}
+
+// Runs frontEnd (everything the tool does with a source: lexing, parsing,
+// printing, reporting errors, and compiling what parses) on each adversarial
+// shape at four sizes doubling up to options.bytes, each the best of
+// options.repeat samples, and fits the exponent k of time ~ size^k. Linear work
+// comes out near 1, n log n near 1.1 and quadratic near 2; returns 1 if any
+// shape is above MAX_COMPLEXITY_EXPONENT.
+//
+// Noise margin: with the default sizes (128K to 1M) and best of 5, every
+// shape fits between 0.8 and 1.15 on a quiet machine. Shapes that are one
+// long token run at memory bandwidth, so from 1M to 8M, where the input
+// outgrows the caches, they fit up to about 1.25 and can be flagged; judge
+// larger sizes by the times rather than the verdict.
+const double MAX_COMPLEXITY_EXPONENT = 1.2;
+
+// A sample shorter than this is mostly timer and scheduler noise, so short
+// runs are repeated within a sample until it lasts at least this long
+const double MIN_COMPLEXITY_SAMPLE = 2e-3;
+
+template <typename F>
+int runComplexity(std::ostream &out, const Dialect &dialect, const BenchOptions &options, F frontEnd)
+{
+    const size_t STEPS = 4;
+    size_t smallest = std::max<size_t>(options.bytes >> (STEPS - 1), 1024);
+    out << dialect.name << ": complexity from " << smallest << " to " << (smallest << (STEPS - 1))
+        << " bytes, best of " << options.repeat << ", limit size^" << MAX_COMPLEXITY_EXPONENT << '\n';
+    int status = 0;
+    for (size_t shape = 0; shape < std::size(adversarialShapes); shape++)
+    {
+        double times[STEPS];
+        for (size_t step = 0; step < STEPS; step++)
+        {
+            std::string src = adversarialInput(dialect, shape, smallest << step);
+            double once = bestTime(1, [&]
+                                   { frontEnd(src); });
+            size_t runs = std::max<size_t>(size_t(MIN_COMPLEXITY_SAMPLE / std::max(once, 1e-9)), 1);
+            times[step] = bestTime(options.repeat, [&]
+                                   {
+                for (size_t run = 0; run < runs; run++)
+                    frontEnd(src); }) / runs;
+        }
+        double exponent = growthExponent(times, STEPS);
+        bool superlinear = exponent > MAX_COMPLEXITY_EXPONENT;
+        status |= superlinear;
+        out << std::left << std::setw(16) << adversarialShapes[shape] << std::right << std::fixed
+            << std::setprecision(2);
+        for (double seconds : times)
+            out << std::setw(10) << seconds * 1e3 << " ms";
+        out << "   size^" << exponent << (superlinear ? "  SUPERLINEAR\n" : "\n") << std::defaultfloat;
+    }
+    out.flush();
+    return status;
+}
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef CHAR_SCAN_H
+#define CHAR_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "line_index.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <immintrin.h>
+#define CHAR_SCAN_X86 1
+#endif
+
+// Character classes used by the lexers. Unlike isspace()/isalpha() these do
+// not consult the locale, and they match the "C" locale exactly.
+enum CharClass : uint8_t
+{
+    CC_SPACE = 1, // ' ', '\t', '\n', '\v', '\f', '\r'
+    CC_DIGIT = 2,
+    CC_ALPHA = 4,
+};
+
+struct CharClassTable
+{
+    uint8_t bits[256];
+    constexpr CharClassTable() : bits()
+    {
+        const char spaces[] = " \t\n\v\f\r";
+        for (size_t i = 0; i + 1 < sizeof(spaces); i++)
+            bits[(unsigned char)spaces[i]] = CC_SPACE;
+        for (int c = '0'; c <= '9'; c++)
+            bits[c] = CC_DIGIT;
+        for (int c = 'a'; c <= 'z'; c++)
+            bits[c] = bits[c - 'a' + 'A'] = CC_ALPHA;
+    }
+};
+constexpr CharClassTable charClasses;
+
+inline bool isSpaceChar(char c) { return charClasses.bits[(unsigned char)c] & CC_SPACE; }
+inline bool isDigitChar(char c) { return charClasses.bits[(unsigned char)c] & CC_DIGIT; }
+inline bool isAlphaChar(char c) { return charClasses.bits[(unsigned char)c] & CC_ALPHA; }
+inline bool isAlnumChar(char c) { return charClasses.bits[(unsigned char)c] & (CC_ALPHA | CC_DIGIT); }
+
+// Run scanners: each returns the first position in [p, end) whose character
+// is outside the class. skipSpace also records in `lines` the start of every
+// line it crosses, as an offset from `base`. The implementation (AVX2, SSE2
+// or scalar) is picked once at startup from what the CPU supports.
+struct CharScanner
+{
+    const char *(*skipSpace)(const char *p, const char *end, const char *base, LineIndex &lines);
+    const char *(*skipAlnum)(const char *p, const char *end);
+    const char *(*skipDigits)(const char *p, const char *end);
+};
+
+namespace char_scan
+{
+inline const char *scalarSkip(const char *p, const char *end, uint8_t mask)
+{
+    while (p < end && (charClasses.bits[(unsigned char)*p] & mask))
+        p++;
+    return p;
+}
+inline const char *scalarSkipSpace(const char *p, const char *end, const char *base, LineIndex &lines)
+{
+    for (; p < end && isSpaceChar(*p); p++)
+        if (*p == '\n')
+            lines.addLine(p - base + 1);
+    return p;
+}
+// Records a line start after each '\n' flagged in `mask` (bit i = p[i])
+inline void addLines(uint32_t mask, const char *p, const char *base, LineIndex &lines)
+{
+    for (; mask != 0; mask &= mask - 1)
+        lines.addLine(p - base + __builtin_ctz(mask) + 1);
+}
+inline const char *scalarSkipAlnum(const char *p, const char *end)
+{
+    return scalarSkip(p, end, CC_ALPHA | CC_DIGIT);
+}
+inline const char *scalarSkipDigits(const char *p, const char *end)
+{
+    return scalarSkip(p, end, CC_DIGIT);
+}
+
+#ifdef CHAR_SCAN_X86
+// Byte-wise class tests. Bytes >= 0x80 are negative under the signed
+// compares and so never fall inside any of the ASCII ranges.
+inline __m128i inRange16(__m128i v, char lo, char hi)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+inline __m128i spaceMask16(__m128i v)
+{
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), inRange16(v, '\t', '\r'));
+}
+inline __m128i alnumMask16(__m128i v)
+{
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    return _mm_or_si128(inRange16(v, '0', '9'), inRange16(lower, 'a', 'z'));
+}
+
+inline const char *sse2SkipSpace(const char *p, const char *end, const char *base, LineIndex &lines)
+{
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned space = _mm_movemask_epi8(spaceMask16(v));
+        unsigned lf = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        if (space != 0xFFFF)
+        {
+            unsigned n = __builtin_ctz(~space);
+            addLines(lf & ((1u << n) - 1), p, base, lines);
+            return p + n;
+        }
+        addLines(lf, p, base, lines);
+    }
+    return scalarSkipSpace(p, end, base, lines);
+}
+inline const char *sse2SkipAlnum(const char *p, const char *end)
+{
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned hit = _mm_movemask_epi8(alnumMask16(v));
+        if (hit != 0xFFFF)
+            return p + __builtin_ctz(~hit);
+    }
+    return scalarSkipAlnum(p, end);
+}
+inline const char *sse2SkipDigits(const char *p, const char *end)
+{
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned hit = _mm_movemask_epi8(inRange16(v, '0', '9'));
+        if (hit != 0xFFFF)
+            return p + __builtin_ctz(~hit);
+    }
+    return scalarSkipDigits(p, end);
+}
+
+#define CHAR_SCAN_AVX2 __attribute__((target("avx2")))
+CHAR_SCAN_AVX2 inline __m256i inRange32(__m256i v, char lo, char hi)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+CHAR_SCAN_AVX2 inline const char *avx2SkipSpace(const char *p, const char *end, const char *base, LineIndex &lines)
+{
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), inRange32(v, '\t', '\r'));
+        uint32_t bits = _mm256_movemask_epi8(space);
+        uint32_t lf = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        if (bits != 0xFFFFFFFFu)
+        {
+            unsigned n = __builtin_ctz(~bits);
+            addLines(lf & ((1u << n) - 1), p, base, lines);
+            return p + n;
+        }
+        addLines(lf, p, base, lines);
+    }
+    return sse2SkipSpace(p, end, base, lines);
+}
+CHAR_SCAN_AVX2 inline const char *avx2SkipAlnum(const char *p, const char *end)
+{
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i hit = _mm256_or_si256(inRange32(v, '0', '9'), inRange32(lower, 'a', 'z'));
+        uint32_t bits = _mm256_movemask_epi8(hit);
+        if (bits != 0xFFFFFFFFu)
+            return p + __builtin_ctz(~bits);
+    }
+    return sse2SkipAlnum(p, end);
+}
+CHAR_SCAN_AVX2 inline const char *avx2SkipDigits(const char *p, const char *end)
+{
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        uint32_t bits = _mm256_movemask_epi8(inRange32(v, '0', '9'));
+        if (bits != 0xFFFFFFFFu)
+            return p + __builtin_ctz(~bits);
+    }
+    return sse2SkipDigits(p, end);
+}
+#undef CHAR_SCAN_AVX2
+#endif
+
+inline CharScanner selectScanner()
+{
+#ifdef CHAR_SCAN_X86
+    if (__builtin_cpu_supports("avx2"))
+        return CharScanner{avx2SkipSpace, avx2SkipAlnum, avx2SkipDigits};
+    return CharScanner{sse2SkipSpace, sse2SkipAlnum, sse2SkipDigits};
+#endif
+    return CharScanner{scalarSkipSpace, scalarSkipAlnum, scalarSkipDigits};
+}
+} // namespace char_scan
+
+inline const CharScanner &charScanner()
+{
+    static const CharScanner scanner = char_scan::selectScanner();
+    return scanner;
+}
+
+#endif
@@ -0,0 +1,1208 @@
+#ifndef FRONTEND_H
+#define FRONTEND_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+
+#include "char_scan.h"
+#include "keywords.h"
+#include "line_index.h"
+#include "symbol_pool.h"
+
+// The lexer, parser and AST shared by the parser.cpp, data_types.cpp and
+// line_number.cpp drivers. Each driver describes its language in a syntax
+// traits struct and instantiates BasicLexer and BasicParser with it, so
+// keywords, declarable types and statement forms are fixed at compile time
+// and the generated code has no dialect checks left in it. A syntax struct
+// has these static constexpr members:
+//
+//     const char *name;       the driver's name
+//     KeywordTable keywords;  its reserved words
+//     TokenType types[];      keywords that start a declaration
+//     TokenType ifKeyword;    keyword that starts an if statement
+//     bool loops;             while, for, print, break and continue
+//     bool decimals;          numbers may have a fractional part
+//     bool comparisons;       ==, !=, < and <= besides >
+//     bool logical;           && and ||
+//     bool booleans;          true and false are literals
+//
+// The token types are the union of every dialect's; a dialect's lexer never
+// produces the ones it has no use for.
+enum TokenType : uint8_t
+{
+    T_ID,
+    T_LT,
+    T_NEQ,
+    T_MUL,
+    T_EQ,
+    T_LE,
+    T_ASSIGN,
+    T_GT,
+    T_INT,
+    T_EOF,
+    T_FLOAT,
+    T_AND,
+    T_DIV,
+    T_RETURN,
+    T_IF,
+    T_AGAR,
+    T_NUM,
+    T_ELSE,
+    T_PLUS,
+    T_MINUS,
+    T_LPAREN,
+    T_RPAREN,
+    T_LBRACE,
+    T_RBRACE,
+    T_STRING,
+    T_SEMICOLON,
+    // extra additions
+    T_AND_OP,
+    T_OR_OP,
+    T_BREAK,
+    T_CONTINUE,
+    T_BOOL,
+    T_TRUE,
+    T_FALSE,
+    T_PRINT,
+    // loops
+    T_WHILE,
+    T_FOR,
+    // declarable types of data_types.cpp
+    T_DOUBLE,
+    T_CHAR,
+};
+inline std::string tokenTypeToString(TokenType type)
+{
+    switch (type)
+    {
+        // loops
+    case T_WHILE:
+        return "T_WHILE";
+    case T_FOR:
+        return "T_FOR";
+    case T_AGAR:
+        return "T_AGAR";
+    case T_IF:
+        return "T_IF";
+    case T_ID:
+        return "T_ID";
+    case T_EQ:
+        return "T_EQ";
+    case T_NEQ:
+        return "T_NEQ";
+    case T_LE:
+        return "T_LE";
+    case T_LT:
+        return "T_LT";
+    case T_AND_OP:
+        return "T_AND_OP";
+    case T_OR_OP:
+        return "T_OR_OP";
+    case T_GT:
+        return "T_GT";
+    case T_INT:
+        return "T_INT";
+    case T_EOF:
+        return "T_EOF";
+    case T_AND:
+        return "T_AND";
+    case T_MUL:
+        return "T_MUL";
+    case T_DIV:
+        return "T_DIV";
+    case T_NUM:
+        return "T_NUM";
+    case T_ELSE:
+        return "T_ELSE";
+    case T_PLUS:
+        return "T_PLUS";
+    case T_MINUS:
+        return "T_MINUS";
+    case T_FLOAT:
+        return "T_FLOAT";
+    case T_RETURN:
+        return "T_RETURN";
+    case T_ASSIGN:
+        return "T_ASSIGN";
+    case T_LPAREN:
+        return "T_LPAREN";
+    case T_RPAREN:
+        return "T_RPAREN";
+    case T_LBRACE:
+        return "T_LBRACE";
+    case T_RBRACE:
+        return "T_RBRACE";
+    case T_STRING:
+        return "T_STRING";
+    case T_SEMICOLON:
+        return "T_SEMICOLON";
+    case T_BREAK:
+        return "T_BREAK";
+    case T_CONTINUE:
+        return "T_CONTINUE";
+    case T_BOOL:
+        return "T_BOOL";
+    case T_TRUE:
+        return "T_TRUE";
+    case T_FALSE:
+        return "T_FALSE";
+    case T_PRINT:
+        return "T_PRINT";
+    case T_DOUBLE:
+        return "T_DOUBLE";
+    case T_CHAR:
+        return "T_CHAR";
+    default:
+        return "Unknown Token";
+    };
+}
+
+struct Token
+{
+    TokenType type;
+    uint32_t symbol; // a T_ID's interned name
+    std::string_view value; // view into the lexer's source buffer, never owns; its
+                       // position there is the token's location
+};
+
+// Struct-of-arrays token storage: a 1-byte kind, 32-bit source offset and
+// 32-bit length per token, 9 bytes in all against 24 for a Token. The text
+// is recovered from the source and the line number is derived on demand.
+// Offsets are 32-bit, so a packed stream covers sources below 4 GB. A T_ID
+// keeps its symbol ID in the length slot instead; its length is that of
+// the name in the SymbolPool.
+struct PackedTokens
+{
+    std::vector<uint8_t> kinds;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+
+    size_t size() const { return kinds.size(); }
+    void clear()
+    {
+        kinds.clear();
+        offsets.clear();
+        lengths.clear();
+    }
+    void resize(size_t count)
+    {
+        kinds.resize(count);
+        offsets.resize(count);
+        lengths.resize(count);
+    }
+    void push(TokenType type, size_t offset, size_t length)
+    {
+        kinds.push_back(type);
+        offsets.push_back(offset);
+        lengths.push_back(length);
+    }
+    // Where token i ends in the source
+    size_t end(size_t i, const SymbolPool &symbols) const
+    {
+        return offsets[i] + (kinds[i] == T_ID ? symbols.name(lengths[i]).size() : lengths[i]);
+    }
+};
+
+// A problem found while lexing or parsing. Diagnostics are collected so a
+// run reports every error it finds rather than stopping at the first.
+struct Diagnostic
+{
+    size_t offset; // where in the source the problem was found
+    std::string message;
+};
+
+class Diagnostics
+{
+private:
+    std::vector<Diagnostic> list;
+
+public:
+    void report(size_t offset, std::string message)
+    {
+        list.push_back(Diagnostic{offset, std::move(message)});
+    }
+    bool empty() const { return list.empty(); }
+    size_t size() const { return list.size(); }
+    void clear() { list.clear(); }
+    // Takes over the diagnostics of a slice of the source starting at `base`
+    void append(const Diagnostics &slice, size_t base)
+    {
+        for (const Diagnostic &diagnostic : slice.list)
+            list.push_back(Diagnostic{diagnostic.offset + base, diagnostic.message});
+    }
+    // Puts the diagnostics in source order. The lexer runs ahead of the
+    // parser, so reports can arrive out of order.
+    void sort()
+    {
+        std::stable_sort(list.begin(), list.end(), [](const Diagnostic &a, const Diagnostic &b)
+                    { return a.offset < b.offset; });
+    }
+    const std::vector<Diagnostic> &all() const { return list; }
+    // Prints every diagnostic in source order with its line and column
+    void print(std::ostream &out, const LineIndex &lines)
+    {
+        sort();
+        for (const Diagnostic &diagnostic : list)
+            out << diagnostic.message << " on line " << lines.locate(diagnostic.offset) << '\n';
+    }
+};
+
+template <typename Syntax>
+class BasicLexer
+{
+private:
+    std::string_view src; // caller keeps the source alive while its tokens are in use
+    size_t pos;
+    LineIndex &lines;        // line starts seen so far, filled while skipping whitespace
+    const CharScanner &scan; // vectorized run scanners picked for this CPU
+    Diagnostics &diagnostics;
+    SymbolPool &symbols; // identifiers are interned here
+
+public:
+    // `lines` should start out empty; it is filled in as the source is lexed
+    BasicLexer(std::string_view src, LineIndex &lines, Diagnostics &diagnostics, SymbolPool &symbols)
+        : src(src), pos(0), lines(lines), scan(charScanner()), diagnostics(diagnostics), symbols(symbols) {}
+    std::string_view source() const { return src; }
+    // Covers every line up to the current position
+    const LineIndex &lineIndex() const { return lines; }
+    // Skips a run of whitespace, recording where the lines in it start
+    void skipSpace()
+    {
+        pos = scan.skipSpace(src.data() + pos, src.data() + src.size(), src.data(), lines) - src.data();
+    }
+    std::string_view consumeNumber()
+    {
+        size_t start = pos;
+        pos = scan.skipDigits(src.data() + pos, src.data() + src.size()) - src.data();
+        if constexpr (Syntax::decimals)
+        {
+            if (pos < src.size() && src[pos] == '.')
+                pos = scan.skipDigits(src.data() + pos + 1, src.data() + src.size()) - src.data();
+        }
+        return src.substr(start, pos - start);
+    }
+
+    std::string_view consumeWord()
+    {
+        size_t start = pos;
+        pos = scan.skipAlnum(src.data() + pos, src.data() + src.size()) - src.data();
+        return src.substr(start, pos - start);
+    }
+    // Builds a one-character token at pos and steps past it
+    Token single(TokenType type)
+    {
+        Token token{type, 0, src.substr(pos, 1)};
+        pos++;
+        return token;
+    }
+    // Builds a two-character operator token at pos and steps past it
+    Token pair(TokenType type)
+    {
+        Token token{type, 0, src.substr(pos, 2)};
+        pos += 2;
+        return token;
+    }
+    bool nextIs(char c) const
+    {
+        return pos + 1 < src.size() && src[pos + 1] == c;
+    }
+    // Lexes and returns the next token on demand. Once the source is
+    // exhausted every further call returns T_EOF, whose empty value sits at
+    // the end of the source.
+    Token next()
+    {
+        while (pos < src.size())
+        {
+            char current = src[pos];
+            if (isSpaceChar(current))
+            {
+                skipSpace();
+                continue;
+            }
+            else if (isDigitChar(current))
+            {
+                return Token{T_NUM, 0, consumeNumber()};
+            }
+            else if (isAlphaChar(current))
+            {
+                std::string_view word = consumeWord();
+                TokenType type = Syntax::keywords.lookup(word, T_ID);
+                return Token{type, type == T_ID ? symbols.intern(word) : 0, word};
+            }
+            // Handle symbols and operators
+            switch (current)
+            {
+            case '+':
+                return single(T_PLUS);
+            case '-':
+                return single(T_MINUS);
+            case '*':
+                return single(T_MUL);
+            case '/':
+                return single(T_DIV);
+            case '=':
+                if (Syntax::comparisons && nextIs('='))
+                    return pair(T_EQ);
+                return single(T_ASSIGN);
+            case '<':
+                if (!Syntax::comparisons)
+                    break;
+                return nextIs('=') ? pair(T_LE) : single(T_LT); // Handle '<' and '<='
+            case '>':
+                return single(T_GT);
+            case '!':
+                if (Syntax::comparisons && nextIs('='))
+                    return pair(T_NEQ); // Handle '!='
+                break;
+            case '&':
+                if (Syntax::logical && nextIs('&'))
+                    return pair(T_AND_OP); // Handle '&&'
+                break;
+            case '|':
+                if (Syntax::logical && nextIs('|'))
+                    return pair(T_OR_OP); // Handle '||'
+                break;
+            case '(':
+                return single(T_LPAREN);
+            case ')':
+                return single(T_RPAREN);
+            case '{':
+                return single(T_LBRACE);
+            case '}':
+                return single(T_RBRACE);
+            case ';':
+                return single(T_SEMICOLON);
+            default:
+                break;
+            }
+            // Anything that did not return above, including an operator
+            // this dialect lacks, is not part of the language
+            diagnostics.report(pos, std::string("Unexpected character: ") + current);
+            pos++;
+        }
+        return Token{TokenType::T_EOF, 0, src.substr(src.size())};
+    }
+    // Lexes the whole source up front, for callers that want every token
+    std::vector<Token> tokenize()
+    {
+        std::vector<Token> tokens;
+        do
+            tokens.push_back(next());
+        while (tokens.back().type != T_EOF);
+        return tokens;
+    }
+    // Lexes the whole source into packed storage, replacing what `tokens`
+    // held before; the trailing T_EOF sits at offset src.size() with length 0
+    void tokenizePacked(PackedTokens &tokens)
+    {
+        tokens.clear();
+        for (Token token = next(); token.type != T_EOF; token = next())
+            tokens.push(token.type, token.value.data() - src.data(),
+                        token.type == T_ID ? token.symbol : token.value.size());
+        tokens.push(T_EOF, src.size(), 0);
+    }
+};
+
+// Bump allocator for AST nodes. Memory comes in chunks that double in size,
+// starting from `firstChunk`; chunks of 2 MB and up are mmapped and backed by
+// transparent huge pages, which keeps page faults down on big inputs. Nodes
+// are never freed one by one. reset() rewinds the arena so the chunks are
+// reused by the next parse, and the destructor releases them all.
+class Arena
+{
+private:
+    static constexpr size_t FIRST_CHUNK = 64 * 1024;
+    static constexpr size_t MAX_CHUNK = 64 * 1024 * 1024;
+    static constexpr size_t HUGE_PAGE = 2 * 1024 * 1024;
+    struct Chunk
+    {
+        char *base;
+        size_t size;
+    };
+    std::vector<Chunk> chunks;
+    size_t firstChunk;
+    size_t current; // index of the chunk being filled
+    char *ptr;
+    char *end;
+
+    void *grow(size_t size, size_t align)
+    {
+        // Move on to the next retained chunk that is big enough, or add one
+        for (current = chunks.empty() ? 0 : current + 1; current < chunks.size(); current++)
+            if (chunks[current].size >= size + align)
+                break;
+        if (current == chunks.size())
+        {
+            size_t bytes = chunks.empty() ? firstChunk : std::min(chunks.back().size * 2, MAX_CHUNK);
+            bytes = std::max(bytes, size + align);
+            char *base;
+            if (bytes >= HUGE_PAGE)
+            {
+                void *mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (mapped == MAP_FAILED)
+                    throw std::bad_alloc();
+                madvise(mapped, bytes, MADV_HUGEPAGE);
+                base = static_cast<char *>(mapped);
+            }
+            else
+            {
+                base = new char[bytes];
+            }
+            chunks.push_back(Chunk{base, bytes});
+        }
+        ptr = chunks[current].base;
+        end = ptr + chunks[current].size;
+        return allocate(size, align);
+    }
+
+public:
+    Arena(size_t firstChunk = FIRST_CHUNK) : firstChunk(firstChunk), current(0), ptr(nullptr), end(nullptr) {}
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena()
+    {
+        for (const Chunk &chunk : chunks)
+        {
+            if (chunk.size >= HUGE_PAGE)
+                munmap(chunk.base, chunk.size);
+            else
+                delete[] chunk.base;
+        }
+    }
+    void *allocate(size_t size, size_t align)
+    {
+        char *p = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(ptr) + align - 1) & ~(uintptr_t)(align - 1));
+        if (ptr == nullptr || p + size > end)
+            return grow(size, align);
+        ptr = p + size;
+        return p;
+    }
+    // Constructs a T in the arena. T must be trivially destructible since
+    // destructors are never run.
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...};
+    }
+    void reset()
+    {
+        current = 0;
+        ptr = chunks.empty() ? nullptr : chunks[0].base;
+        end = chunks.empty() ? nullptr : ptr + chunks[0].size;
+    }
+};
+
+// AST produced by the Parser. Nodes live in an Arena; names and numbers
+// are views into the source buffer.
+enum ExprKind : uint8_t
+{
+    E_NUM,
+    E_ID,
+    E_BOOL,
+    E_BINARY
+};
+
+struct Expr
+{
+    ExprKind kind;
+    TokenType op;     // operator of an E_BINARY
+    uint32_t symbol;  // interned name of an E_ID
+    std::string_view text; // spelling of an E_NUM, E_ID or E_BOOL, in the source
+    Expr *lhs;
+    Expr *rhs;
+};
+
+enum StmtKind : uint8_t
+{
+    S_DECL,
+    S_ASSIGN,
+    S_WHILE,
+    S_FOR,
+    S_IF,
+    S_RETURN,
+    S_PRINT,
+    S_BREAK,
+    S_CONTINUE,
+    S_BLOCK
+};
+
+struct Stmt
+{
+    StmtKind kind;
+    TokenType type;        // type keyword of an S_DECL
+    uint32_t symbol;       // interned name of the variable
+    std::string_view name; // variable declared or assigned, or the break or
+                           // continue keyword, in the source
+    Expr *expr;       // assigned value, loop/if condition, returned or printed value
+    Stmt *body;       // loop or if body, first statement of a block
+    Stmt *elseBody;   // else branch of an if
+    Stmt *init;       // for loop initializer
+    Stmt *step;       // for loop step
+    Stmt *next;       // next statement in the same block or program
+};
+
+// Token cursors the Parser reads through. Both expose the current token's
+// type, text and source offset, map offsets to line and column, and step
+// forward with advance(); at the end they keep returning T_EOF.
+
+// Pulls tokens from the lexer as the parser asks for them and keeps them in
+// a small ring buffer, so memory use does not grow with the input.
+template <typename Lexer>
+class LexerCursor
+{
+private:
+    static constexpr size_t LOOKAHEAD = 4;
+    Lexer &lexer;
+    Token buffer[LOOKAHEAD];
+    size_t head;  // slot holding the current token
+    size_t count; // number of tokens lexed but not yet consumed
+
+public:
+    LexerCursor(Lexer &lexer) : lexer(lexer), head(0), count(0) {}
+    // Returns the token `ahead` positions past the current one (ahead < LOOKAHEAD)
+    const Token &peek(size_t ahead = 0)
+    {
+        while (count <= ahead)
+        {
+            buffer[(head + count) % LOOKAHEAD] = lexer.next();
+            count++;
+        }
+        return buffer[(head + ahead) % LOOKAHEAD];
+    }
+    TokenType type() { return peek().type; }
+    uint32_t symbol() { return peek().symbol; }
+    std::string_view text() { return type() == T_EOF ? "EOF" : peek().value; }
+    size_t offset() { return peek().value.data() - lexer.source().data(); }
+    // The lexer has always indexed the lines up to its lookahead
+    LineIndex::Location locate(size_t offset) const { return lexer.lineIndex().locate(offset); }
+    void advance()
+    {
+        peek();
+        head = (head + 1) % LOOKAHEAD;
+        count--;
+    }
+};
+
+// Walks the tokens [begin, end) of a PackedTokens stream, then reports
+// T_EOF at `end` (by default the stream's own trailing T_EOF). Only the kind
+// array is touched on the hot path; text and location are looked up when a
+// caller asks for them.
+class PackedCursor
+{
+private:
+    const PackedTokens &tokens;
+    std::string_view src;
+    const LineIndex &lines;
+    const SymbolPool &symbols; // names of the T_ID tokens
+    size_t pos;
+    size_t end;
+
+public:
+    PackedCursor(const PackedTokens &tokens, std::string_view src, const LineIndex &lines, const SymbolPool &symbols)
+        : tokens(tokens), src(src), lines(lines), symbols(symbols), pos(0), end(tokens.size() - 1) {}
+    PackedCursor(const PackedTokens &tokens, std::string_view src, const LineIndex &lines, const SymbolPool &symbols,
+                 size_t begin, size_t end)
+        : tokens(tokens), src(src), lines(lines), symbols(symbols), pos(begin), end(end) {}
+    TokenType type() const { return pos == end ? T_EOF : TokenType(tokens.kinds[pos]); }
+    uint32_t symbol() const { return tokens.lengths[pos]; }
+    std::string_view text() const
+    {
+        TokenType kind = type();
+        if (kind == T_EOF)
+            return "EOF";
+        if (kind == T_ID) // the spelling in the source, so its position is known
+            return src.substr(tokens.offsets[pos], symbols.name(tokens.lengths[pos]).size());
+        return src.substr(tokens.offsets[pos], tokens.lengths[pos]);
+    }
+    size_t offset() const { return tokens.offsets[pos]; }
+    LineIndex::Location locate(size_t offset) const { return lines.locate(offset); }
+    void advance()
+    {
+        if (pos < end)
+            pos++;
+    }
+};
+
+// Binding strength of each binary operator, as in C: || then && then
+// equality then relational then additive then multiplicative. Anything
+// else has precedence 0 and ends an expression.
+struct BinaryOperator
+{
+    uint8_t precedence = 0;
+    bool rightAssociative = false;
+};
+struct BinaryOperatorTable
+{
+    BinaryOperator table[256];
+    constexpr BinaryOperatorTable() : table()
+    {
+        table[T_OR_OP] = {1, false};
+        table[T_AND_OP] = {2, false};
+        table[T_EQ] = table[T_NEQ] = {3, false};
+        table[T_LT] = table[T_LE] = table[T_GT] = {4, false};
+        table[T_PLUS] = table[T_MINUS] = {5, false};
+        table[T_MUL] = table[T_DIV] = {6, false};
+    }
+    constexpr BinaryOperator of(TokenType type) const { return table[uint8_t(type)]; }
+};
+constexpr BinaryOperatorTable binaryOperators;
+
+// Thrown by the parser after reporting a syntax error; caught by the
+// nearest statement list, which resynchronizes and carries on
+struct SyntaxError
+{
+    bool skipped = false; // the parser already skipped the failed statement
+};
+
+// Deepest nesting of statements and parenthesized expressions the parser
+// accepts by default. The parser itself runs in constant native stack at any
+// depth, but the AST printers and later passes walk the tree recursively.
+const size_t DEFAULT_DEPTH_LIMIT = 10000;
+
+// Recursive descent run on an explicit stack. Each compound statement being
+// parsed is a Frame on a heap-allocated vector instead of a native call, and
+// expressions are parsed by a shunting-yard loop over operand and operator
+// stacks, so nesting depth costs heap memory rather than native stack.
+// Nesting beyond depthLimit is reported as a syntax error and skipped.
+template <typename Syntax, typename Cursor>
+class BasicParser
+{
+private:
+    // What a frame is waiting for: the statements of a list (a block, or the
+    // whole program), or the single statement that is the body of a while,
+    // for or if (and then its else branch)
+    enum FrameKind : uint8_t
+    {
+        F_LIST,
+        F_BODY,
+        F_IF_BODY,
+        F_ELSE_BODY,
+    };
+    struct Frame
+    {
+        FrameKind kind;
+        TokenType end; // F_LIST: the token that closes the list
+        Stmt *stmt;    // the statement the frame belongs to; null for the program
+        Stmt **tail;   // F_LIST: where the next statement is linked
+        size_t start;  // F_LIST: offset of the statement being parsed
+    };
+
+    Cursor tokens;
+    Arena &arena;
+    Diagnostics &diagnostics;
+    size_t depthLimit;
+    size_t deepest; // deepest nesting reached so far
+    std::vector<Frame> frames;
+    std::vector<Expr *> operands;     // shunting-yard stacks, for one expression
+    std::vector<TokenType> operators; // at a time; T_LPAREN marks an open group
+
+    Expr *makeExpr(ExprKind kind, uint32_t symbol, std::string_view text)
+    {
+        return arena.make<Expr>(kind, T_EOF, symbol, text, nullptr, nullptr);
+    }
+    Expr *makeBinary(TokenType op, Expr *lhs, Expr *rhs)
+    {
+        return arena.make<Expr>(E_BINARY, op, 0u, std::string_view(), lhs, rhs);
+    }
+    Stmt *makeStmt(StmtKind kind)
+    {
+        return arena.make<Stmt>(kind, T_EOF, 0u, std::string_view(), nullptr, nullptr, nullptr, nullptr, nullptr,
+                                nullptr);
+    }
+    // Whether a token starts a declaration in this dialect
+    static constexpr bool declares(TokenType type)
+    {
+        for (TokenType declarable : Syntax::types)
+            if (type == declarable)
+                return true;
+        return false;
+    }
+    // Records a syntax error at the current token and abandons the statement
+    [[noreturn]] void error(std::string message)
+    {
+        diagnostics.report(tokens.offset(), std::move(message));
+        throw SyntaxError{};
+    }
+    // Notes that something starts at nesting `level`. Past the limit this
+    // is reported, and the rest of the statement it is in skipped: up to a
+    // ';' or a balanced '}' not followed by 'else', or an unmatched '}'.
+    // Synchronizing instead would resume inside the statement at a shallow
+    // depth, and a long chain would then report once per depthLimit levels.
+    void enter(size_t level)
+    {
+        deepest = std::max(deepest, level);
+        if (level > depthLimit)
+            tooDeep();
+    }
+    [[noreturn]] __attribute__((noinline, cold)) void tooDeep()
+    {
+        diagnostics.report(tokens.offset(), "Syntax error: nesting deeper than " + std::to_string(depthLimit) + " levels");
+        size_t open = 0;
+        while (tokens.type() != T_EOF)
+        {
+            TokenType type = tokens.type();
+            if (type == T_RBRACE && open == 0)
+                break;
+            tokens.advance();
+            if (type == T_LBRACE || type == T_LPAREN)
+                open++;
+            else if ((type == T_RBRACE || type == T_RPAREN) && open > 0)
+                open--;
+            if (open == 0 && (type == T_SEMICOLON || type == T_RBRACE) && tokens.type() != T_ELSE)
+                break;
+        }
+        throw SyntaxError{true};
+    }
+    // Panic-mode recovery: skips to just past the next ';', or up to the
+    // next '}' or token that can only start a statement
+    void synchronize()
+    {
+        while (true)
+        {
+            switch (tokens.type())
+            {
+            case T_SEMICOLON:
+                tokens.advance();
+                return;
+            case T_RBRACE:
+            case T_LBRACE:
+            case T_WHILE:
+            case T_FOR:
+            case T_RETURN:
+            case T_BREAK:
+            case T_CONTINUE:
+            case T_PRINT:
+            case T_EOF:
+                return;
+            default:
+                if (declares(tokens.type()) || tokens.type() == Syntax::ifKeyword)
+                    return;
+                tokens.advance();
+            }
+        }
+    }
+    // Drives the frames until the program's statement list is finished.
+    // A finished statement is handed to the frame that was waiting for it;
+    // a syntax error escapes to parseProgram, which recovers in the
+    // innermost statement list.
+    void run()
+    {
+        Stmt *stmt = nullptr; // finished, not yet handed over
+        while (!frames.empty())
+        {
+            Frame &top = frames.back();
+            if (stmt != nullptr)
+            {
+                switch (top.kind)
+                {
+                case F_LIST:
+                    *top.tail = stmt;
+                    top.tail = &stmt->next;
+                    stmt = nullptr;
+                    break;
+                case F_BODY:
+                    top.stmt->body = stmt;
+                    stmt = top.stmt;
+                    frames.pop_back();
+                    break;
+                case F_IF_BODY:
+                    top.stmt->body = stmt;
+                    stmt = nullptr;
+                    if (tokens.type() == T_ELSE)
+                    {
+                        expect(T_ELSE);
+                        top.kind = F_ELSE_BODY;
+                    }
+                    else
+                    {
+                        stmt = top.stmt;
+                        frames.pop_back();
+                    }
+                    break;
+                case F_ELSE_BODY:
+                    top.stmt->elseBody = stmt;
+                    stmt = top.stmt;
+                    frames.pop_back();
+                    break;
+                }
+            }
+            else if (top.kind != F_LIST)
+            {
+                stmt = parseStatement();
+            }
+            else if (tokens.type() == top.end || tokens.type() == T_EOF)
+            {
+                Stmt *block = top.stmt;
+                frames.pop_back();
+                if (block != nullptr)
+                {
+                    expect(T_RBRACE);
+                    stmt = block;
+                }
+            }
+            else
+            {
+                top.start = tokens.offset();
+                stmt = parseStatement();
+            }
+        }
+    }
+    void pushFrame(FrameKind kind, Stmt *stmt)
+    {
+        frames.push_back(Frame{kind, T_EOF, stmt, nullptr, 0});
+    }
+    // Folds the operators on top of the stack that bind at least as tightly
+    // as minPrecedence into their operands
+    void reduce(int minPrecedence)
+    {
+        while (!operators.empty() && binaryOperators.of(operators.back()).precedence >= minPrecedence)
+        {
+            Expr *rhs = operands.back();
+            operands.pop_back();
+            operands.back() = makeBinary(operators.back(), operands.back(), rhs);
+            operators.pop_back();
+        }
+    }
+
+public:
+    BasicParser(Cursor tokens, Arena &arena, Diagnostics &diagnostics, size_t depthLimit = DEFAULT_DEPTH_LIMIT)
+        : tokens(tokens), arena(arena), diagnostics(diagnostics), depthLimit(depthLimit), deepest(0) {}
+    // Deepest nesting of statements and expressions reached so far
+    size_t maxDepth() const { return deepest; }
+    // Parses the whole input and returns its first top-level statement.
+    // Statements with syntax errors are reported and left out.
+    Stmt *parseProgram()
+    {
+        Stmt *first = nullptr;
+        frames.clear();
+        frames.push_back(Frame{F_LIST, T_EOF, nullptr, &first, 0});
+        while (!frames.empty())
+        {
+            try
+            {
+                run();
+            }
+            catch (const SyntaxError &error)
+            {
+                // The failed statement is abandoned along with everything
+                // open inside it, back to the list it started in
+                while (frames.back().kind != F_LIST)
+                    frames.pop_back();
+                size_t start = frames.back().start;
+                if (!error.skipped)
+                    synchronize();
+                // A statement that fails on its first token, say a stray
+                // '}' at the top level, must not be retried forever
+                if (tokens.offset() == start && tokens.type() != T_EOF)
+                    tokens.advance();
+            }
+        }
+        return first;
+    }
+    // Parses a simple statement whole and returns it. A compound statement
+    // gets as far as its body: it pushes a frame for the body, which run()
+    // parses next, and returns null.
+    Stmt *parseStatement()
+    {
+        enter(frames.size());
+        if (declares(tokens.type()))
+        {
+            return parseDeclaration();
+        }
+        else if (tokens.type() == T_ID)
+        {
+            return parseAssignment();
+        }
+        else if (Syntax::loops && tokens.type() == T_WHILE)
+        {
+            return parseWhileStatement();
+        }
+        else if (Syntax::loops && tokens.type() == T_FOR)
+        {
+            return parseForStatement();
+        }
+        else if (tokens.type() == Syntax::ifKeyword)
+        {
+            return parseIfStatement();
+        }
+        else if (tokens.type() == T_RETURN)
+        {
+            return parseReturnStatement();
+        }
+        else if (tokens.type() == T_LBRACE)
+        {
+            return parseBlock();
+        }
+        else if (Syntax::loops && tokens.type() == T_BREAK)
+        {
+            Stmt *stmt = makeStmt(S_BREAK);
+            stmt->name = tokens.text();
+            expect(T_BREAK);
+            expect(T_SEMICOLON);
+            return stmt;
+        }
+        else if (Syntax::loops && tokens.type() == T_CONTINUE)
+        {
+            Stmt *stmt = makeStmt(S_CONTINUE);
+            stmt->name = tokens.text();
+            expect(T_CONTINUE);
+            expect(T_SEMICOLON);
+            return stmt;
+        }
+        else if (Syntax::loops && tokens.type() == T_PRINT)
+        {
+            Stmt *stmt = makeStmt(S_PRINT);
+            expect(T_PRINT);
+            expect(T_LPAREN);
+            stmt->expr = parseExpression();
+            expect(T_RPAREN);
+            expect(T_SEMICOLON);
+            return stmt;
+        }
+        else
+        {
+            error("Syntax error: unexpected token " + std::string(tokens.text()));
+        }
+    }
+    Stmt *parseBlock()
+    {
+        Stmt *block = makeStmt(S_BLOCK);
+        expect(T_LBRACE);
+        frames.push_back(Frame{F_LIST, T_RBRACE, block, &block->body, tokens.offset()});
+        return nullptr;
+    }
+    Stmt *parseDeclaration()
+    {
+        Stmt *stmt = makeStmt(S_DECL);
+        stmt->type = tokens.type();
+        expect(stmt->type);
+        stmt->symbol = tokens.symbol(); // checked by the expect below
+        stmt->name = expect(T_ID);
+        expect(T_SEMICOLON);
+        return stmt;
+    }
+    // The step of a for loop is an assignment without the trailing ';'
+    Stmt *parseAssignment(bool terminated = true)
+    {
+        Stmt *stmt = makeStmt(S_ASSIGN);
+        stmt->symbol = tokens.symbol(); // checked by the expect below
+        stmt->name = expect(T_ID);
+        expect(T_ASSIGN);
+        stmt->expr = parseExpression();
+        if (terminated)
+            expect(T_SEMICOLON);
+        return stmt;
+    }
+    Stmt *parseWhileStatement()
+    {
+        Stmt *stmt = makeStmt(S_WHILE);
+        expect(T_WHILE);
+        expect(T_LPAREN);
+        stmt->expr = parseExpression();
+        expect(T_RPAREN);
+        pushFrame(F_BODY, stmt);
+        return nullptr;
+    }
+    Stmt *parseForStatement()
+    {
+        Stmt *stmt = makeStmt(S_FOR);
+        expect(T_FOR);
+        expect(T_LPAREN);
+        stmt->init = parseAssignment();
+        stmt->expr = parseExpression();
+        expect(T_SEMICOLON);
+        stmt->step = parseAssignment(false);
+        expect(T_RPAREN);
+        pushFrame(F_BODY, stmt);
+        return nullptr;
+    }
+
+    Stmt *parseIfStatement()
+    {
+        Stmt *stmt = makeStmt(S_IF);
+        expect(Syntax::ifKeyword);
+        expect(T_LPAREN);
+        stmt->expr = parseExpression();
+        expect(T_RPAREN);
+        pushFrame(F_IF_BODY, stmt);
+        return nullptr;
+    }
+    Stmt *parseReturnStatement()
+    {
+        Stmt *stmt = makeStmt(S_RETURN);
+        expect(T_RETURN);
+        stmt->expr = parseExpression();
+        expect(T_SEMICOLON);
+        return stmt;
+    }
+    // Shunting-yard over the binary operator table: each operand (after any
+    // opening parentheses) is followed by an operator, which first folds in
+    // the operators on the stack that bind at least as tightly, or by the
+    // end of a group or of the whole expression. Left-associative operators
+    // come out left-nested, as precedence climbing would build them.
+    Expr *parseExpression()
+    {
+        size_t level = frames.size() + 1;
+        enter(level);
+        operands.clear();
+        operators.clear();
+        size_t groups = 0; // open parentheses
+        while (true)
+        {
+            while (tokens.type() == T_LPAREN)
+            {
+                enter(level + groups + 1);
+                operators.push_back(T_LPAREN);
+                groups++;
+                tokens.advance();
+            }
+            if (tokens.type() == T_NUM || tokens.type() == T_ID)
+            {
+                if (tokens.type() == T_ID)
+                    operands.push_back(makeExpr(E_ID, tokens.symbol(), tokens.text()));
+                else
+                    operands.push_back(makeExpr(E_NUM, 0, tokens.text()));
+                tokens.advance(); // Consume numbers or identifiers
+            }
+            else if (Syntax::booleans && (tokens.type() == T_TRUE || tokens.type() == T_FALSE))
+            {
+                operands.push_back(makeExpr(E_BOOL, 0, tokens.text()));
+                tokens.advance();
+            }
+            else
+            {
+                error("Syntax error: unexpected token '" + std::string(tokens.text()) + "'");
+            }
+            while (true)
+            {
+                TokenType op = tokens.type();
+                BinaryOperator binary = binaryOperators.of(op);
+                if (binary.precedence != 0)
+                {
+                    reduce(binary.rightAssociative ? binary.precedence + 1 : binary.precedence);
+                    operators.push_back(op);
+                    tokens.advance();
+                    break;
+                }
+                reduce(1);
+                if (groups == 0)
+                    return operands.back();
+                expect(T_RPAREN); // Ensure matching parentheses
+                operators.pop_back();
+                groups--;
+            }
+        }
+    }
+    // Consumes a token of the given type and returns its text
+    std::string_view expect(TokenType type)
+    {
+        if (tokens.type() == type)
+        {
+            std::string_view text = tokens.text();
+            tokens.advance();
+            return text;
+        }
+        else
+        {
+            error("Syntax error: expected " + tokenTypeToString(type) + " but found '" + std::string(tokens.text()) + "'");
+        }
+    }
+};
+
+// Prints an expression in fully parenthesized form. An operator chain nests
+// down its left operands as deep as it is long, so the left spine is walked
+// with a loop; right operands nest only as deep as parentheses and
+// precedence levels, which the parser's depth limit bounds.
+inline void dumpExpr(const Expr *expr, std::ostream &out)
+{
+    std::vector<const Expr *> spine;
+    for (; expr->kind == E_BINARY; expr = expr->lhs)
+        spine.push_back(expr);
+    out << std::string(spine.size(), '(') << expr->text;
+    while (!spine.empty())
+    {
+        const Expr *binary = spine.back();
+        spine.pop_back();
+        out << ' ' << tokenTypeToString(binary->op) << ' ';
+        dumpExpr(binary->rhs, out);
+        out << ')';
+    }
+}
+
+// Prints a statement list, one statement per line, nested bodies indented.
+// Keywords are spelled as in the dialect that was parsed.
+template <typename Syntax>
+void dumpStmts(const Stmt *stmt, std::ostream &out, int depth = 0)
+{
+    for (; stmt != nullptr; stmt = stmt->next)
+    {
+        out << std::string(depth * 2, ' ');
+        switch (stmt->kind)
+        {
+        case S_DECL:
+            out << Syntax::keywords.spelling(stmt->type) << ' ' << stmt->name << '\n';
+            break;
+        case S_ASSIGN:
+            out << stmt->name << " = ";
+            dumpExpr(stmt->expr, out);
+            out << '\n';
+            break;
+        case S_WHILE:
+            out << "while ";
+            dumpExpr(stmt->expr, out);
+            out << '\n';
+            dumpStmts<Syntax>(stmt->body, out, depth + 1);
+            break;
+        case S_FOR:
+            out << "for " << stmt->init->name << " = ";
+            dumpExpr(stmt->init->expr, out);
+            out << "; ";
+            dumpExpr(stmt->expr, out);
+            out << "; " << stmt->step->name << " = ";
+            dumpExpr(stmt->step->expr, out);
+            out << '\n';
+            dumpStmts<Syntax>(stmt->body, out, depth + 1);
+            break;
+        case S_IF:
+            out << Syntax::keywords.spelling(Syntax::ifKeyword) << ' ';
+            dumpExpr(stmt->expr, out);
+            out << '\n';
+            dumpStmts<Syntax>(stmt->body, out, depth + 1);
+            if (stmt->elseBody != nullptr)
+            {
+                out << std::string(depth * 2, ' ') << "else\n";
+                dumpStmts<Syntax>(stmt->elseBody, out, depth + 1);
+            }
+            break;
+        case S_RETURN:
+        case S_PRINT:
+            out << (stmt->kind == S_RETURN ? "return " : "print ");
+            dumpExpr(stmt->expr, out);
+            out << '\n';
+            break;
+        case S_BREAK:
+            out << "break\n";
+            break;
+        case S_CONTINUE:
+            out << "continue\n";
+            break;
+        case S_BLOCK:
+            out << "block\n";
+            dumpStmts<Syntax>(stmt->body, out, depth + 1);
+            break;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,76 @@
+// libFuzzer target for the lexer and parser of all three dialects.
+//
+//   clang++ -std=c++17 -O1 -g -fsanitize=fuzzer,address,undefined fuzz_frontend.cpp -o fuzz_frontend
+//   ./fuzz_frontend -max_len=65536 -timeout=5 -report_slow_units=1 corpus/
+//
+// Each input is parsed by every dialect twice, once from packed tokens and
+// once streaming from the lexer; the two must print the same tree and the
+// same diagnostics. An input that takes far longer than its size warrants
+// aborts, so the fuzzer keeps it as a crash rather than only logging it.
+#include "syntaxes.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+// Time allowed for one dialect on one input: generous enough for a
+// sanitized build, far below what a quadratic path needs at max_len
+const double BUDGET_BASE_MS = 100;
+const double BUDGET_PER_BYTE_MS = 0.02;
+
+template <typename Syntax, typename Parse>
+string parseAndPrint(Parse parse)
+{
+    LineIndex lines;
+    Diagnostics diagnostics;
+    SymbolPool symbols;
+    Arena arena;
+    ostringstream out;
+    dumpStmts<Syntax>(parse(lines, diagnostics, symbols, arena), out);
+    diagnostics.print(out, lines);
+    return out.str();
+}
+
+template <typename Syntax>
+void fuzzDialect(string_view src)
+{
+    using Lexer = BasicLexer<Syntax>;
+    auto start = chrono::steady_clock::now();
+    string packed = parseAndPrint<Syntax>([&](LineIndex &lines, Diagnostics &diagnostics, SymbolPool &symbols, Arena &arena)
+    {
+        PackedTokens tokens;
+        Lexer(src, lines, diagnostics, symbols).tokenizePacked(tokens);
+        return BasicParser<Syntax, PackedCursor>(PackedCursor(tokens, src, lines, symbols), arena, diagnostics).parseProgram();
+    });
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    if (ms > BUDGET_BASE_MS + BUDGET_PER_BYTE_MS * src.size())
+    {
+        fprintf(stderr, "%s: %zu bytes took %.1f ms\n", Syntax::name, src.size(), ms);
+        abort();
+    }
+
+    string streamed = parseAndPrint<Syntax>([&](LineIndex &lines, Diagnostics &diagnostics, SymbolPool &symbols, Arena &arena)
+    {
+        Lexer lexer(src, lines, diagnostics, symbols);
+        return BasicParser<Syntax, LexerCursor<Lexer>>(LexerCursor<Lexer>(lexer), arena, diagnostics).parseProgram();
+    });
+    if (packed != streamed)
+    {
+        fprintf(stderr, "%s: packed and streaming parses differ\n--- packed\n%s--- streaming\n%s",
+                Syntax::name, packed.c_str(), streamed.c_str());
+        abort();
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    string_view src(reinterpret_cast<const char *>(data), size);
+    fuzzDialect<AgarSyntax>(src);
+    fuzzDialect<DataTypesSyntax>(src);
+    fuzzDialect<LineNumberSyntax>(src);
+    return 0;
+}
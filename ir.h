@@ -0,0 +1,1475 @@
+#ifndef IR_H
+#define IR_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "frontend.h"
+#include "vm.h"
+
+// A linear SSA intermediate representation for the programs parser.cpp
+// parses, the passes that optimize it, and code generation from it to the
+// VM's bytecode (vm.h).
+//
+// A program is a graph of basic blocks. Each block holds a list of
+// instructions and ends in a jump, a two-way branch, a return or a halt.
+// Every instruction that produces a value defines it exactly once and is
+// named by its index, its value number; variables do not appear at all.
+// Where control flow merges, a phi instruction picks the value from the
+// predecessor the block was entered from. && and || become control flow
+// with a phi at the join, as in C, so branch folding applies to them too.
+//
+// Lowering builds SSA form directly from the structured AST. The value of
+// each variable is tracked while lowering, with an undo log of changes like
+// TypeChecker's scopes: at an if's join, phis are made for exactly the
+// variables either branch changed, and a loop header gets phis for the
+// variables its body assigns, found by a scan of the body beforehand.
+// Phis that turn out to merge one value are left for copy propagation.
+enum IrOp : uint8_t
+{
+    IR_NOP,   // removed by a pass
+    IR_CONST, // `value`; depends on nothing, so it may be used anywhere
+    IR_PHI,   // one operand per predecessor of the block, in the same order
+    IR_COPY,  // args[0]
+    // Arithmetic and comparisons, in the same order as the VM's opcodes
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_LT,
+    IR_LE,
+    IR_GT,
+    IR_EQ,
+    IR_NEQ,
+    IR_BOOL,  // 0 if args[0] is 0, else 1
+    IR_PRINT, // prints args[0]; has no value
+};
+
+struct IrInst
+{
+    IrOp op;
+    uint32_t args[2]; // operands; for a phi, its first index in IrProgram::phiArgs and their count
+    int64_t value;    // of an IR_CONST
+    uint32_t offset;  // in the source, for runtime errors
+};
+
+enum IrExit : uint8_t
+{
+    EXIT_JUMP,   // to targets[0]
+    EXIT_BRANCH, // to targets[0] if `value` is not 0, else to targets[1]
+    EXIT_RETURN, // stops the program with `value`
+    EXIT_HALT,   // stops the program with 0
+};
+
+struct IrBlock
+{
+    std::vector<uint32_t> insts; // phis first
+    std::vector<uint32_t> preds;
+    IrExit exit = EXIT_HALT;
+    uint32_t value = 0;
+    uint32_t targets[2] = {0, 0};
+    bool live = true; // false once removed as unreachable
+
+    size_t successors() const { return exit == EXIT_BRANCH ? 2 : exit == EXIT_JUMP ? 1 : 0; }
+};
+
+struct IrProgram
+{
+    std::vector<IrInst> insts; // by value number
+    std::vector<uint32_t> phiArgs;
+    std::vector<IrBlock> blocks; // block 0 is the entry
+    std::vector<uint32_t> layout; // live blocks, in the order code is generated for them
+
+    static size_t operandCount(IrOp op)
+    {
+        return op == IR_NOP || op == IR_CONST || op == IR_PHI ? 0 : op == IR_COPY || op == IR_BOOL || op == IR_PRINT ? 1 : 2;
+    }
+    uint32_t *phiBegin(uint32_t phi) { return phiArgs.data() + insts[phi].args[0]; }
+    uint32_t *phiEnd(uint32_t phi) { return phiBegin(phi) + insts[phi].args[1]; }
+    const uint32_t *phiBegin(uint32_t phi) const { return phiArgs.data() + insts[phi].args[0]; }
+    const uint32_t *phiEnd(uint32_t phi) const { return phiBegin(phi) + insts[phi].args[1]; }
+    // The value v stands for, looking through copies
+    uint32_t resolve(uint32_t v) const
+    {
+        while (insts[v].op == IR_COPY)
+            v = insts[v].args[0];
+        return v;
+    }
+    bool isConstant(uint32_t v) const { return insts[v].op == IR_CONST; }
+    // Removes `pred` from the predecessors of `block`, and its operand from
+    // every phi there
+    void removePred(uint32_t block, uint32_t pred)
+    {
+        std::vector<uint32_t> &preds = blocks[block].preds;
+        size_t index = std::find(preds.begin(), preds.end(), pred) - preds.begin();
+        if (index == preds.size())
+            return;
+        preds.erase(preds.begin() + index);
+        for (uint32_t id : blocks[block].insts)
+        {
+            if (insts[id].op != IR_PHI)
+                continue;
+            std::copy(phiBegin(id) + index + 1, phiEnd(id), phiBegin(id) + index);
+            insts[id].args[1]--;
+        }
+    }
+    // How many operands, phi operands and block exits name each value
+    std::vector<uint32_t> countUses() const
+    {
+        std::vector<uint32_t> uses(insts.size(), 0);
+        for (uint32_t block : layout)
+        {
+            const IrBlock &b = blocks[block];
+            if (b.exit == EXIT_BRANCH || b.exit == EXIT_RETURN)
+                uses[b.value]++;
+            for (uint32_t id : b.insts)
+            {
+                if (insts[id].op == IR_PHI)
+                    for (const uint32_t *arg = phiBegin(id); arg != phiEnd(id); arg++)
+                        uses[*arg]++;
+                else
+                    for (size_t i = 0; i < operandCount(insts[id].op); i++)
+                        uses[insts[id].args[i]]++;
+            }
+        }
+        return uses;
+    }
+    size_t instructionCount() const
+    {
+        size_t count = 0;
+        for (uint32_t block : layout)
+            count += blocks[block].insts.size();
+        return count;
+    }
+};
+
+// Lowers a parsed program to IR. Statements nest as deep as the parser's
+// depth limit allows and are lowered recursively; operator chains are
+// walked down their left spine with a loop.
+class IrLowering
+{
+private:
+    struct Change
+    {
+        uint32_t symbol;
+        uint32_t value;
+    };
+    // Control flow into a join: the block it comes from and the variables
+    // changed on the way since the join's enclosing statement began
+    struct Edge
+    {
+        uint32_t block;
+        std::vector<Change> changes;
+    };
+    struct Loop
+    {
+        size_t base;            // log size when the body began
+        uint32_t continueBlock; // the header, or the step of a for loop
+        uint32_t exitBlock;
+        std::vector<Edge> continues;
+        std::vector<Edge> breaks;
+    };
+
+    std::string_view src; // the AST's names and numbers are views into it
+    Diagnostics &diagnostics;
+    IrProgram &ir;
+    uint32_t block = 0; // being lowered into
+    uint32_t zero = 0;  // the constant 0 in the entry block
+    std::vector<uint32_t> current; // value of each variable, by symbol ID
+    std::vector<Change> log;       // previous values of changed variables
+    std::vector<uint32_t> marks;   // per symbol, to visit each once per scan
+    uint32_t mark = 0;
+    std::vector<uint32_t> phiOf; // per symbol, its phi in the join being built
+    std::vector<Loop> loops;
+    std::vector<const Expr *> spine;
+
+    size_t offsetOf(std::string_view text) const { return text.data() - src.data(); }
+
+    uint32_t newBlock()
+    {
+        ir.blocks.emplace_back();
+        return uint32_t(ir.blocks.size() - 1);
+    }
+    void start(uint32_t next)
+    {
+        block = next;
+        ir.layout.push_back(next);
+    }
+    uint32_t add(IrOp op, uint32_t a = 0, uint32_t b = 0, size_t offset = 0, int64_t value = 0)
+    {
+        ir.insts.push_back(IrInst{op, {a, b}, value, uint32_t(offset)});
+        uint32_t id = uint32_t(ir.insts.size() - 1);
+        ir.blocks[block].insts.push_back(id);
+        return id;
+    }
+    uint32_t constant(int64_t value, size_t offset) { return add(IR_CONST, 0, 0, offset, value); }
+    // A phi in the current block with `count` operands, all `value`
+    uint32_t phi(size_t count, uint32_t value)
+    {
+        uint32_t id = add(IR_PHI, uint32_t(ir.phiArgs.size()), uint32_t(count));
+        ir.phiArgs.insert(ir.phiArgs.end(), count, value);
+        return id;
+    }
+    void jump(uint32_t target)
+    {
+        ir.blocks[block].exit = EXIT_JUMP;
+        ir.blocks[block].targets[0] = target;
+    }
+    void branch(uint32_t condition, uint32_t ifTrue, uint32_t ifFalse)
+    {
+        IrBlock &from = ir.blocks[block];
+        from.exit = EXIT_BRANCH;
+        from.value = condition;
+        from.targets[0] = ifTrue;
+        from.targets[1] = ifFalse;
+    }
+    // Code after a return, break or continue goes in a block nothing enters
+    void unreachable() { start(newBlock()); }
+
+    void write(uint32_t symbol, uint32_t value)
+    {
+        log.push_back(Change{symbol, current[symbol]});
+        current[symbol] = value;
+    }
+    void rollback(size_t base)
+    {
+        for (; log.size() > base; log.pop_back())
+            current[log.back().symbol] = log.back().value;
+    }
+    // Jumps to `target`, adding the edge, with the variables changed since
+    // `base`, to `edges`. A block nothing enters (code after a break, say)
+    // halts instead, so it adds no operands to the target's phis.
+    void leave(std::vector<Edge> &edges, uint32_t target, size_t base)
+    {
+        if (block != 0 && ir.blocks[block].preds.empty())
+            return;
+        jump(target);
+        Edge edge{block, {}};
+        mark++;
+        for (size_t i = base; i < log.size(); i++)
+        {
+            uint32_t symbol = log[i].symbol;
+            if (marks[symbol] != mark)
+            {
+                marks[symbol] = mark;
+                edge.changes.push_back(Change{symbol, current[symbol]});
+            }
+        }
+        edges.push_back(std::move(edge));
+    }
+    // Starts `join`, entered along `edges`, with a phi for each variable
+    // some edge changed. The variables must be as they were before any
+    // edge's changes.
+    void join(uint32_t next, const std::vector<Edge> &edges)
+    {
+        start(next);
+        for (const Edge &edge : edges)
+            ir.blocks[next].preds.push_back(edge.block);
+        if (edges.size() == 1)
+        {
+            for (const Change &change : edges[0].changes)
+                write(change.symbol, change.value);
+            return;
+        }
+        std::vector<uint32_t> symbols;
+        mark++;
+        for (size_t i = 0; i < edges.size(); i++)
+        {
+            for (const Change &change : edges[i].changes)
+            {
+                if (marks[change.symbol] != mark)
+                {
+                    marks[change.symbol] = mark;
+                    phiOf[change.symbol] = phi(edges.size(), current[change.symbol]);
+                    symbols.push_back(change.symbol);
+                }
+                ir.phiBegin(phiOf[change.symbol])[i] = change.value;
+            }
+        }
+        for (uint32_t symbol : symbols)
+            write(symbol, phiOf[symbol]);
+    }
+    // Adds every variable the statements assign to `symbols`, once each
+    void assigned(const Stmt *stmt, std::vector<uint32_t> &symbols)
+    {
+        for (; stmt != nullptr; stmt = stmt->next)
+        {
+            if ((stmt->kind == S_DECL || stmt->kind == S_ASSIGN) && marks[stmt->symbol] != mark)
+            {
+                marks[stmt->symbol] = mark;
+                symbols.push_back(stmt->symbol);
+            }
+            assigned(stmt->body, symbols);
+            assigned(stmt->elseBody, symbols);
+            assigned(stmt->init, symbols);
+            assigned(stmt->step, symbols);
+        }
+    }
+
+    uint32_t leaf(const Expr *expr)
+    {
+        size_t offset = offsetOf(expr->text);
+        int64_t value = 0;
+        if (expr->kind == E_ID)
+            return current[expr->symbol];
+        if (expr->kind == E_BOOL)
+            value = expr->text == "true";
+        else if (!literalValue(expr->text, value))
+            diagnostics.report(offset, outOfRangeError(expr->text));
+        return constant(value, offset);
+    }
+    static IrOp opFor(TokenType op)
+    {
+        switch (op)
+        {
+        case T_PLUS:
+            return IR_ADD;
+        case T_MINUS:
+            return IR_SUB;
+        case T_MUL:
+            return IR_MUL;
+        case T_DIV:
+            return IR_DIV;
+        case T_LT:
+            return IR_LT;
+        case T_LE:
+            return IR_LE;
+        case T_GT:
+            return IR_GT;
+        case T_EQ:
+            return IR_EQ;
+        default:
+            return IR_NEQ;
+        }
+    }
+    uint32_t expression(const Expr *expr)
+    {
+        size_t base = spine.size();
+        for (; expr->kind == E_BINARY; expr = expr->lhs)
+            spine.push_back(expr);
+        // Every operator on the spine reports at its leftmost operand
+        size_t leftmost = offsetOf(expr->text);
+        uint32_t value = leaf(expr);
+        while (spine.size() > base)
+        {
+            const Expr *binary = spine.back();
+            spine.pop_back();
+            if (binary->op == T_AND_OP || binary->op == T_OR_OP)
+            {
+                // The left operand decides the result unless it is true
+                // (for &&) or false (for ||); then the right one does
+                bool isAnd = binary->op == T_AND_OP;
+                uint32_t decided = constant(isAnd ? 0 : 1, leftmost);
+                uint32_t from = block, right = newBlock(), end = newBlock();
+                branch(value, isAnd ? right : end, isAnd ? end : right);
+                start(right);
+                ir.blocks[right].preds.push_back(from);
+                uint32_t rhs = add(IR_BOOL, expression(binary->rhs));
+                uint32_t rightEnd = block;
+                jump(end);
+                start(end);
+                ir.blocks[end].preds = {from, rightEnd};
+                value = phi(2, decided);
+                ir.phiBegin(value)[1] = rhs;
+            }
+            else
+            {
+                uint32_t rhs = expression(binary->rhs);
+                value = add(opFor(binary->op), value, rhs, leftmost);
+            }
+        }
+        return value;
+    }
+
+    void statements(const Stmt *stmt)
+    {
+        for (; stmt != nullptr; stmt = stmt->next)
+            statement(stmt);
+    }
+    void loop(const Stmt *stmt)
+    {
+        if (stmt->kind == S_FOR)
+            statement(stmt->init);
+        uint32_t preheader = block, header = newBlock(), body = newBlock(), exit = newBlock();
+        uint32_t step = stmt->kind == S_FOR ? newBlock() : header;
+        jump(header);
+        start(header);
+
+        std::vector<uint32_t> symbols, phis, entries;
+        mark++;
+        assigned(stmt->body, symbols);
+        if (stmt->kind == S_FOR)
+            assigned(stmt->step, symbols);
+        for (uint32_t symbol : symbols)
+        {
+            entries.push_back(current[symbol]);
+            phis.push_back(add(IR_PHI)); // operands once the back edges are known
+            write(symbol, phis.back());
+        }
+        size_t base = log.size();
+        uint32_t condition = expression(stmt->expr);
+        uint32_t test = block;
+        branch(condition, body, exit);
+
+        loops.push_back(Loop{base, step, exit, {}, {}});
+        start(body);
+        ir.blocks[body].preds.push_back(test);
+        statements(stmt->body);
+        leave(loops.back().continues, step, base);
+        rollback(base);
+        std::vector<Edge> backEdges;
+        if (stmt->kind == S_FOR)
+        {
+            join(step, loops.back().continues);
+            statement(stmt->step);
+            leave(backEdges, header, base);
+            rollback(base);
+        }
+        else
+            backEdges = std::move(loops.back().continues);
+
+        // The header is entered first from before the loop, then along each back edge
+        ir.blocks[header].preds.push_back(preheader);
+        for (const Edge &edge : backEdges)
+            ir.blocks[header].preds.push_back(edge.block);
+        for (size_t i = 0; i < symbols.size(); i++)
+        {
+            ir.insts[phis[i]].args[0] = uint32_t(ir.phiArgs.size());
+            ir.insts[phis[i]].args[1] = uint32_t(backEdges.size() + 1);
+            ir.phiArgs.push_back(entries[i]);
+            ir.phiArgs.insert(ir.phiArgs.end(), backEdges.size(), phis[i]);
+            phiOf[symbols[i]] = phis[i];
+        }
+        for (size_t i = 0; i < backEdges.size(); i++)
+            for (const Change &change : backEdges[i].changes)
+                ir.phiBegin(phiOf[change.symbol])[i + 1] = change.value;
+
+        std::vector<Edge> exits;
+        exits.push_back(Edge{test, {}});
+        for (Edge &edge : loops.back().breaks)
+            exits.push_back(std::move(edge));
+        loops.pop_back();
+        join(exit, exits);
+    }
+    void statement(const Stmt *stmt)
+    {
+        switch (stmt->kind)
+        {
+        case S_DECL:
+            write(stmt->symbol, zero);
+            break;
+        case S_ASSIGN:
+        {
+            uint32_t value = expression(stmt->expr);
+            // A plain `x = y` is kept as a copy for copy propagation to remove
+            if (stmt->expr->kind == E_ID)
+                value = add(IR_COPY, value, 0, offsetOf(stmt->name));
+            write(stmt->symbol, value);
+            break;
+        }
+        case S_WHILE:
+        case S_FOR:
+            loop(stmt);
+            break;
+        case S_IF:
+        {
+            uint32_t condition = expression(stmt->expr);
+            size_t base = log.size();
+            uint32_t from = block, then = newBlock();
+            uint32_t otherwise = stmt->elseBody != nullptr ? newBlock() : 0, end = newBlock();
+            branch(condition, then, stmt->elseBody != nullptr ? otherwise : end);
+            std::vector<Edge> edges;
+            if (stmt->elseBody == nullptr)
+                edges.push_back(Edge{from, {}});
+            start(then);
+            ir.blocks[then].preds.push_back(from);
+            statements(stmt->body);
+            leave(edges, end, base);
+            rollback(base);
+            if (stmt->elseBody != nullptr)
+            {
+                start(otherwise);
+                ir.blocks[otherwise].preds.push_back(from);
+                statements(stmt->elseBody);
+                leave(edges, end, base);
+                rollback(base);
+            }
+            join(end, edges);
+            break;
+        }
+        case S_RETURN:
+            ir.blocks[block].value = expression(stmt->expr);
+            ir.blocks[block].exit = EXIT_RETURN;
+            unreachable();
+            break;
+        case S_PRINT:
+            add(IR_PRINT, expression(stmt->expr));
+            break;
+        case S_BREAK:
+        case S_CONTINUE:
+            if (loops.empty())
+            {
+                diagnostics.report(offsetOf(stmt->name), "Compile error: " + std::string(stmt->name) + " outside a loop");
+                break;
+            }
+            if (stmt->kind == S_BREAK)
+                leave(loops.back().breaks, loops.back().exitBlock, loops.back().base);
+            else
+                leave(loops.back().continues, loops.back().continueBlock, loops.back().base);
+            unreachable();
+            break;
+        case S_BLOCK:
+            statements(stmt->body);
+            break;
+        }
+    }
+
+public:
+    // `src` is the source the program was parsed from and `symbols` the pool
+    // its names were interned in
+    IrLowering(std::string_view src, const SymbolPool &symbols, Diagnostics &diagnostics, IrProgram &ir)
+        : src(src), diagnostics(diagnostics), ir(ir), marks(symbols.size(), 0), phiOf(symbols.size(), 0)
+    {
+        start(newBlock());
+        zero = constant(0, 0);
+        current.assign(symbols.size(), zero); // every variable starts at 0, as in the VM
+    }
+    // Lowers a whole program; its last block halts, as running off the end does
+    void lower(const Stmt *program) { statements(program); }
+};
+
+// The passes. Each changes the program in place and returns whether it
+// changed anything; none of them needs another to have run first.
+
+// Constant folding and propagation: arithmetic, comparisons and phis whose
+// operands are all constants become constants, and x + 0, x - 0, x * 1 and
+// x / 1 become copies of x. SSA makes propagation free, since every use
+// names its definition; the pass repeats until nothing changes so constants
+// also flow around loops. Division by a constant 0 is left for the VM to
+// report.
+inline bool foldConstants(IrProgram &ir)
+{
+    bool changed = false;
+    for (bool again = true; again;)
+    {
+        again = false;
+        for (uint32_t block : ir.layout)
+        {
+            for (uint32_t id : ir.blocks[block].insts)
+            {
+                IrInst &inst = ir.insts[id];
+                if (inst.op == IR_PHI)
+                {
+                    const uint32_t *arg = ir.phiBegin(id), *end = ir.phiEnd(id);
+                    bool same = arg != end;
+                    int64_t value = 0;
+                    bool first = true;
+                    for (; arg != end && same; arg++)
+                    {
+                        uint32_t v = ir.resolve(*arg);
+                        if (v == id)
+                            continue;
+                        same = ir.isConstant(v) && (first || ir.insts[v].value == value);
+                        value = ir.insts[v].value;
+                        first = false;
+                    }
+                    if (same && !first)
+                    {
+                        inst.op = IR_CONST;
+                        inst.value = value;
+                        again = true;
+                    }
+                    continue;
+                }
+                if (inst.op == IR_BOOL)
+                {
+                    uint32_t a = ir.resolve(inst.args[0]);
+                    IrOp from = ir.insts[a].op;
+                    if (from == IR_CONST)
+                    {
+                        inst.op = IR_CONST;
+                        inst.value = ir.insts[a].value != 0;
+                        again = true;
+                    }
+                    else if ((from >= IR_LT && from <= IR_NEQ) || from == IR_BOOL)
+                    {
+                        inst.op = IR_COPY;
+                        inst.args[0] = a;
+                        again = true;
+                    }
+                    continue;
+                }
+                if (inst.op < IR_ADD || inst.op > IR_NEQ)
+                    continue;
+                uint32_t a = ir.resolve(inst.args[0]), b = ir.resolve(inst.args[1]);
+                bool constA = ir.isConstant(a), constB = ir.isConstant(b);
+                // Through uint64_t so that overflow wraps, as in the VM
+                uint64_t x = uint64_t(ir.insts[a].value), y = uint64_t(ir.insts[b].value);
+                if (constA && constB && !(inst.op == IR_DIV && y == 0))
+                {
+                    int64_t lhs = int64_t(x), rhs = int64_t(y), value = 0;
+                    switch (inst.op)
+                    {
+                    case IR_ADD:
+                        value = int64_t(x + y);
+                        break;
+                    case IR_SUB:
+                        value = int64_t(x - y);
+                        break;
+                    case IR_MUL:
+                        value = int64_t(x * y);
+                        break;
+                    case IR_DIV:
+                        value = rhs == -1 ? int64_t(0 - x) : lhs / rhs;
+                        break;
+                    case IR_LT:
+                        value = lhs < rhs;
+                        break;
+                    case IR_LE:
+                        value = lhs <= rhs;
+                        break;
+                    case IR_GT:
+                        value = lhs > rhs;
+                        break;
+                    case IR_EQ:
+                        value = lhs == rhs;
+                        break;
+                    default:
+                        value = lhs != rhs;
+                        break;
+                    }
+                    inst.op = IR_CONST;
+                    inst.value = value;
+                    again = true;
+                    continue;
+                }
+                uint32_t same = UINT32_MAX; // the operand the result equals, if any
+                if ((inst.op == IR_ADD || inst.op == IR_SUB) && constB && y == 0)
+                    same = a;
+                else if (inst.op == IR_ADD && constA && x == 0)
+                    same = b;
+                else if ((inst.op == IR_MUL || inst.op == IR_DIV) && constB && y == 1)
+                    same = a;
+                else if (inst.op == IR_MUL && constA && x == 1)
+                    same = b;
+                if (same != UINT32_MAX)
+                {
+                    inst.op = IR_COPY;
+                    inst.args[0] = same;
+                    again = true;
+                }
+            }
+        }
+        changed |= again;
+    }
+    return changed;
+}
+
+// Branch folding: a branch on a constant becomes a jump, and the block it
+// no longer goes to loses it as a predecessor. Code that becomes
+// unreachable this way is left for dead code elimination.
+//
+// A block holding nothing but phis (and constants) and a branch on one of
+// them, as the joins of && and || do, is skipped by each predecessor that
+// gives that phi a constant: the predecessor goes straight to the side the
+// branch would take. So `a < b && c` tests a < b once, not once and then
+// again as 0 or 1.
+//
+// Last, a block that jumps to one with no other predecessor absorbs it, so
+// straight-line code ends up in one block, where code generation can keep
+// more of it on the operand stack.
+inline void threadBranches(IrProgram &ir, uint32_t block, std::vector<uint32_t> &uses, bool &changed)
+{
+    IrBlock &join = ir.blocks[block];
+    uint32_t condition = ir.resolve(join.value);
+    for (uint32_t id : join.insts)
+        if (ir.insts[id].op != IR_CONST && (ir.insts[id].op != IR_PHI || uses[id] != (id == condition ? 1 : 0)))
+            return;
+    if (std::find(join.insts.begin(), join.insts.end(), condition) == join.insts.end())
+        return;
+    for (size_t i = join.preds.size(); i-- > 0;)
+    {
+        uint32_t pred = join.preds[i], decided = ir.resolve(ir.phiBegin(condition)[i]);
+        IrBlock &from = ir.blocks[pred];
+        if (!ir.isConstant(decided) || (from.exit == EXIT_BRANCH && from.targets[0] == from.targets[1]))
+            continue;
+        uint32_t next = join.targets[ir.insts[decided].value != 0 ? 0 : 1];
+        IrBlock &to = ir.blocks[next];
+        if (next == block || std::find(to.preds.begin(), to.preds.end(), pred) != to.preds.end())
+            continue;
+        from.targets[from.targets[0] == block ? 0 : 1] = next;
+        // The phis of the new target take what they would have through the join
+        size_t through = std::find(to.preds.begin(), to.preds.end(), block) - to.preds.begin();
+        for (uint32_t id : to.insts)
+        {
+            if (ir.insts[id].op != IR_PHI)
+                continue;
+            uint32_t value = ir.phiBegin(id)[through];
+            if (ir.insts[value].op == IR_PHI && std::find(join.insts.begin(), join.insts.end(), value) != join.insts.end())
+                value = ir.phiBegin(value)[i];
+            std::vector<uint32_t> args(ir.phiBegin(id), ir.phiEnd(id));
+            args.push_back(value);
+            uses[value]++;
+            ir.insts[id].args[0] = uint32_t(ir.phiArgs.size());
+            ir.insts[id].args[1] = uint32_t(args.size());
+            ir.phiArgs.insert(ir.phiArgs.end(), args.begin(), args.end());
+        }
+        to.preds.push_back(pred);
+        ir.removePred(block, pred);
+        changed = true;
+    }
+}
+
+inline bool foldBranches(IrProgram &ir)
+{
+    bool changed = false;
+    for (uint32_t block : ir.layout)
+    {
+        IrBlock &from = ir.blocks[block];
+        uint32_t condition = from.exit == EXIT_BRANCH ? ir.resolve(from.value) : 0;
+        if (from.exit != EXIT_BRANCH || !ir.isConstant(condition))
+            continue;
+        uint32_t taken = from.targets[ir.insts[condition].value != 0 ? 0 : 1];
+        uint32_t skipped = from.targets[ir.insts[condition].value != 0 ? 1 : 0];
+        from.exit = EXIT_JUMP;
+        from.targets[0] = taken;
+        if (skipped != taken)
+            ir.removePred(skipped, block);
+        changed = true;
+    }
+    std::vector<uint32_t> uses = ir.countUses();
+    for (uint32_t block : ir.layout)
+        if (ir.blocks[block].exit == EXIT_BRANCH)
+            threadBranches(ir, block, uses, changed);
+    for (uint32_t block : ir.layout)
+    {
+        for (IrBlock *from = &ir.blocks[block]; from->live && from->exit == EXIT_JUMP;)
+        {
+            uint32_t next = from->targets[0];
+            IrBlock &to = ir.blocks[next];
+            if (next == block || next == 0 || to.preds.size() != 1 ||
+                std::any_of(to.insts.begin(), to.insts.end(), [&](uint32_t id)
+                            { return ir.insts[id].op == IR_PHI; }))
+                break;
+            from->insts.insert(from->insts.end(), to.insts.begin(), to.insts.end());
+            from->exit = to.exit;
+            from->value = to.value;
+            from->targets[0] = to.targets[0];
+            from->targets[1] = to.targets[1];
+            for (size_t i = 0; i < to.successors(); i++)
+                for (uint32_t &pred : ir.blocks[to.targets[i]].preds)
+                    pred = pred == next ? block : pred;
+            to.insts.clear();
+            to.preds.clear();
+            to.exit = EXIT_HALT;
+            to.live = false;
+            changed = true;
+        }
+    }
+    ir.layout.erase(std::remove_if(ir.layout.begin(), ir.layout.end(), [&](uint32_t block)
+                                   { return !ir.blocks[block].live; }),
+                    ir.layout.end());
+    return changed;
+}
+
+// Copy propagation: phis whose operands are all one value (or the phi
+// itself, around a loop) become copies of it, then every operand that
+// names a copy is made to name the copied value, and the copies go.
+inline bool propagateCopies(IrProgram &ir)
+{
+    bool changed = false;
+    for (bool again = true; again;)
+    {
+        again = false;
+        for (uint32_t block : ir.layout)
+        {
+            for (uint32_t id : ir.blocks[block].insts)
+            {
+                if (ir.insts[id].op != IR_PHI)
+                    continue;
+                uint32_t unique = UINT32_MAX;
+                bool trivial = true;
+                for (const uint32_t *arg = ir.phiBegin(id); arg != ir.phiEnd(id) && trivial; arg++)
+                {
+                    uint32_t v = ir.resolve(*arg);
+                    if (v != id && unique != UINT32_MAX && v != unique)
+                        trivial = false;
+                    else if (v != id)
+                        unique = v;
+                }
+                if (!trivial)
+                    continue;
+                IrInst &phi = ir.insts[id];
+                if (unique == UINT32_MAX) // entered from nowhere: the block is unreachable
+                {
+                    phi.op = IR_CONST;
+                    phi.value = 0;
+                }
+                else
+                {
+                    phi.op = IR_COPY;
+                    phi.args[0] = unique;
+                }
+                again = changed = true;
+            }
+        }
+    }
+    for (uint32_t block : ir.layout)
+    {
+        IrBlock &b = ir.blocks[block];
+        if (b.exit == EXIT_BRANCH || b.exit == EXIT_RETURN)
+            b.value = ir.resolve(b.value);
+        for (uint32_t id : b.insts)
+        {
+            IrInst &inst = ir.insts[id];
+            if (inst.op == IR_PHI)
+                for (uint32_t *arg = ir.phiBegin(id); arg != ir.phiEnd(id); arg++)
+                    *arg = ir.resolve(*arg);
+            else if (inst.op != IR_COPY)
+                for (size_t i = 0; i < IrProgram::operandCount(inst.op); i++)
+                    inst.args[i] = ir.resolve(inst.args[i]);
+        }
+        size_t before = b.insts.size();
+        b.insts.erase(std::remove_if(b.insts.begin(), b.insts.end(), [&](uint32_t id)
+                                     { return ir.insts[id].op == IR_COPY; }),
+                      b.insts.end());
+        changed |= b.insts.size() != before;
+    }
+    return changed;
+}
+
+// Dead code elimination: blocks that cannot be reached from the entry are
+// removed, along with their operands in the phis of blocks they jumped to,
+// and so are instructions whose values nothing needs. Prints, divisions
+// that may trap, and the values branches and returns use are what is
+// needed, with whatever they need in turn.
+inline bool eliminateDeadCode(IrProgram &ir)
+{
+    bool changed = false;
+    std::vector<uint8_t> reached(ir.blocks.size(), 0);
+    std::vector<uint32_t> work = {0};
+    reached[0] = 1;
+    while (!work.empty())
+    {
+        const IrBlock &b = ir.blocks[work.back()];
+        work.pop_back();
+        for (size_t i = 0; i < b.successors(); i++)
+            if (!reached[b.targets[i]])
+            {
+                reached[b.targets[i]] = 1;
+                work.push_back(b.targets[i]);
+            }
+    }
+    // Constants may be used outside their block (see threadBranches), so
+    // those of removed blocks move to the entry until the sweep below
+    std::vector<uint32_t> constants;
+    for (uint32_t block : ir.layout)
+    {
+        if (reached[block])
+            continue;
+        IrBlock &b = ir.blocks[block];
+        for (size_t i = 0; i < b.successors(); i++)
+            if (reached[b.targets[i]])
+                ir.removePred(b.targets[i], block);
+        for (uint32_t id : b.insts)
+        {
+            if (ir.insts[id].op == IR_CONST)
+                constants.push_back(id);
+            else
+                ir.insts[id].op = IR_NOP;
+        }
+        b.insts.clear();
+        b.live = false;
+        changed = true;
+    }
+    ir.layout.erase(std::remove_if(ir.layout.begin(), ir.layout.end(), [&](uint32_t block)
+                                   { return !ir.blocks[block].live; }),
+                    ir.layout.end());
+    ir.blocks[0].insts.insert(ir.blocks[0].insts.begin(), constants.begin(), constants.end());
+
+    std::vector<uint8_t> needed(ir.insts.size(), 0);
+    auto need = [&](uint32_t v)
+    {
+        if (!needed[v])
+        {
+            needed[v] = 1;
+            work.push_back(v);
+        }
+    };
+    for (uint32_t block : ir.layout)
+    {
+        const IrBlock &b = ir.blocks[block];
+        if (b.exit == EXIT_BRANCH || b.exit == EXIT_RETURN)
+            need(b.value);
+        for (uint32_t id : b.insts)
+        {
+            const IrInst &inst = ir.insts[id];
+            if (inst.op == IR_PRINT)
+                need(id);
+            else if (inst.op == IR_DIV)
+            {
+                uint32_t divisor = ir.resolve(inst.args[1]);
+                if (!ir.isConstant(divisor) || ir.insts[divisor].value == 0)
+                    need(id);
+            }
+        }
+    }
+    while (!work.empty())
+    {
+        uint32_t id = work.back();
+        work.pop_back();
+        const IrInst &inst = ir.insts[id];
+        if (inst.op == IR_PHI)
+            for (const uint32_t *arg = ir.phiBegin(id); arg != ir.phiEnd(id); arg++)
+                need(*arg);
+        else
+            for (size_t i = 0; i < IrProgram::operandCount(inst.op); i++)
+                need(inst.args[i]);
+    }
+    for (uint32_t block : ir.layout)
+    {
+        std::vector<uint32_t> &insts = ir.blocks[block].insts;
+        size_t before = insts.size();
+        insts.erase(std::remove_if(insts.begin(), insts.end(), [&](uint32_t id)
+                                   {
+            if (needed[id])
+                return false;
+            ir.insts[id].op = IR_NOP;
+            return true; }),
+                    insts.end());
+        changed |= insts.size() != before;
+    }
+    return changed;
+}
+
+struct IrPass
+{
+    const char *name;
+    bool (*run)(IrProgram &);
+};
+const IrPass irPasses[] = {
+    {"fold", foldConstants},
+    {"branch", foldBranches},
+    {"copy", propagateCopies},
+    {"dce", eliminateDeadCode},
+};
+// Run in this order by default. Folding runs again after copy propagation,
+// which can turn phis that branch folding left with one operand into copies
+// of constants, and branch folding again after that, since the joins of &&
+// and || only become blocks it can merge once their phis are gone.
+const char *const DEFAULT_IR_PASSES = "fold,branch,copy,fold,branch,dce";
+
+// A sequence of passes, and how long each took the last time it ran
+class IrPipeline
+{
+public:
+    struct Step
+    {
+        const IrPass *pass;
+        double seconds = 0;
+        size_t instructions = 0; // left after the pass
+        size_t blocks = 0;
+    };
+
+private:
+    std::vector<Step> steps;
+
+public:
+    // Selects passes from a comma-separated list of names, or "none".
+    // Returns false, with the unknown name in `error`, if one is not a pass.
+    bool select(std::string_view list, std::string &error)
+    {
+        steps.clear();
+        if (list == "none")
+            return true;
+        while (!list.empty())
+        {
+            size_t comma = std::min(list.find(','), list.size());
+            std::string_view name = list.substr(0, comma);
+            list.remove_prefix(std::min(comma + 1, list.size()));
+            const IrPass *found = nullptr;
+            for (const IrPass &pass : irPasses)
+                if (name == pass.name)
+                    found = &pass;
+            if (found == nullptr)
+            {
+                error = std::string(name);
+                return false;
+            }
+            steps.push_back(Step{found});
+        }
+        return true;
+    }
+    void run(IrProgram &ir)
+    {
+        for (Step &step : steps)
+        {
+            auto start = std::chrono::steady_clock::now();
+            step.pass->run(ir);
+            step.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            step.instructions = ir.instructionCount();
+            step.blocks = ir.layout.size();
+        }
+    }
+    const std::vector<Step> &results() const { return steps; }
+};
+
+// Prints the program one block at a time: "b3 (preds b1 b2):" and then its
+// instructions as "v12 = add v10, v11", ending in its exit
+inline void printIr(const IrProgram &ir, std::ostream &out)
+{
+    static const char *const names[] = {"nop", "const", "phi", "copy", "add", "sub", "mul", "div",
+                                        "lt", "le", "gt", "eq", "neq", "bool", "print"};
+    for (uint32_t block : ir.layout)
+    {
+        const IrBlock &b = ir.blocks[block];
+        out << 'b' << block;
+        if (!b.preds.empty())
+        {
+            out << " (preds";
+            for (uint32_t pred : b.preds)
+                out << " b" << pred;
+            out << ')';
+        }
+        out << ":\n";
+        for (uint32_t id : b.insts)
+        {
+            const IrInst &inst = ir.insts[id];
+            out << "  ";
+            if (inst.op != IR_PRINT)
+                out << 'v' << id << " = ";
+            out << names[inst.op];
+            if (inst.op == IR_CONST)
+                out << ' ' << inst.value;
+            else if (inst.op == IR_PHI)
+                for (const uint32_t *arg = ir.phiBegin(id); arg != ir.phiEnd(id); arg++)
+                    out << (arg == ir.phiBegin(id) ? " v" : ", v") << *arg;
+            else
+                for (size_t i = 0; i < IrProgram::operandCount(inst.op); i++)
+                    out << (i == 0 ? " v" : ", v") << inst.args[i];
+            out << '\n';
+        }
+        switch (b.exit)
+        {
+        case EXIT_JUMP:
+            out << "  jump b" << b.targets[0] << '\n';
+            break;
+        case EXIT_BRANCH:
+            out << "  branch v" << b.value << ", b" << b.targets[0] << ", b" << b.targets[1] << '\n';
+            break;
+        case EXIT_RETURN:
+            out << "  return v" << b.value << '\n';
+            break;
+        case EXIT_HALT:
+            out << "  halt\n";
+            break;
+        }
+    }
+}
+
+// Generates bytecode for the VM from IR. A value used once, in its own
+// block, is computed where it is used and left on the operand stack, so
+// expressions come out as they would from the AST; any other value is
+// stored in a slot, shared with phis it flows into where their lifetimes
+// allow (see coalesce). Constants are pushed where they are used. A phi's
+// operands are pushed at the end of each predecessor and popped into its
+// slot, which copies all of a block's phis at once; a branch to a block
+// with phis goes through a stub that does the copies for that edge alone.
+class IrCodegen
+{
+private:
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+    // Sets of values sharing a slot are compared pairwise; past this many
+    // pairs two sets are left apart rather than spend quadratic time
+    static constexpr size_t MAX_COALESCE_PAIRS = 4096;
+    struct Item
+    {
+        uint32_t value;
+        uint8_t state; // 0: push the value, 1: emit its operation, 2: compute it
+    };
+    struct Stub
+    {
+        size_t jump;
+        uint32_t from, to;
+    };
+
+    const IrProgram &ir;
+    BytecodeBuilder out;
+    std::vector<uint32_t> uses;
+    std::vector<uint32_t> slots;   // by value number
+    std::vector<uint8_t> inlined;  // computed where it is used rather than stored
+    std::vector<uint32_t> userAt;  // of an inlined value, its user's position in the block
+    std::vector<uint8_t> traps;    // may stop the program, itself or by an inlined operand
+    std::vector<uint32_t> leader;  // of each value's set of values sharing a slot
+    std::vector<uint32_t> defBlock, defPos;
+    std::vector<std::vector<uint32_t>> liveIn, liveOut; // by block, sorted
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> lastUse; // by block: value and position, sorted
+    std::vector<size_t> blockCode; // where each block's code starts
+    std::vector<std::pair<size_t, uint32_t>> fixups; // jumps to blocks
+    std::vector<Stub> stubs;
+    std::unordered_map<int64_t, uint32_t> constants;
+    std::vector<Item> work;
+
+    static bool mayTrap(IrOp op) { return op == IR_DIV || op == IR_PRINT; }
+    bool hasPhis(uint32_t block) const
+    {
+        for (uint32_t id : ir.blocks[block].insts)
+            if (ir.insts[id].op == IR_PHI)
+                return true;
+        return false;
+    }
+
+    // A value is inlined into its only user in the same block. If it may
+    // trap, or an operand inlined into it may, nothing between it and its
+    // user may have a side effect either, so the program still stops at the
+    // same point; a pure value can move freely, since SSA values never change.
+    void chooseInlined()
+    {
+        inlined.assign(ir.insts.size(), 0);
+        userAt.assign(ir.insts.size(), 0);
+        std::vector<uint32_t> position(ir.insts.size(), UINT32_MAX), effects;
+        traps.assign(ir.insts.size(), 0);
+        for (uint32_t block : ir.layout)
+        {
+            const IrBlock &b = ir.blocks[block];
+            effects.assign(1, 0); // effects[i]: side effects before position i
+            for (uint32_t i = 0; i < b.insts.size(); i++)
+            {
+                position[b.insts[i]] = i;
+                effects.push_back(effects.back() + mayTrap(ir.insts[b.insts[i]].op));
+            }
+            auto consider = [&](uint32_t v, uint32_t user)
+            {
+                IrOp op = ir.insts[v].op;
+                if (uses[v] == 1 && position[v] < user && op >= IR_COPY && op <= IR_BOOL &&
+                    (!traps[v] || effects[user] == effects[position[v] + 1]))
+                {
+                    inlined[v] = 1;
+                    userAt[v] = user;
+                }
+            };
+            for (uint32_t i = 0; i < b.insts.size(); i++)
+            {
+                uint32_t id = b.insts[i];
+                const IrInst &inst = ir.insts[id];
+                traps[id] = inst.op == IR_DIV;
+                if (inst.op != IR_PHI)
+                    for (size_t k = 0; k < IrProgram::operandCount(inst.op); k++)
+                    {
+                        consider(inst.args[k], i);
+                        traps[id] |= inlined[inst.args[k]] && traps[inst.args[k]];
+                    }
+            }
+            if (b.exit == EXIT_BRANCH || b.exit == EXIT_RETURN)
+                consider(b.value, uint32_t(b.insts.size()));
+            for (uint32_t id : b.insts)
+                position[id] = UINT32_MAX; // positions only count within this block
+        }
+    }
+    // Whether a value is computed into a slot: if it is used, or if it has
+    // to be computed anyway because it may trap
+    bool needsSlot(uint32_t id) const
+    {
+        IrOp op = ir.insts[id].op;
+        return op != IR_NOP && op != IR_CONST && op != IR_PRINT && !inlined[id] && (uses[id] > 0 || traps[id]);
+    }
+    uint32_t find(uint32_t v)
+    {
+        while (leader[v] != v)
+            v = leader[v] = leader[leader[v]];
+        return v;
+    }
+    static bool contains(const std::vector<uint32_t> &set, uint32_t v) { return std::binary_search(set.begin(), set.end(), v); }
+    // Whether x still holds a value needed later just after y is computed
+    bool liveAt(uint32_t x, uint32_t y) const
+    {
+        uint32_t block = defBlock[y];
+        if (ir.insts[y].op == IR_PHI)
+            return contains(liveIn[block], x) || (defBlock[x] == block && ir.insts[x].op == IR_PHI);
+        if (defBlock[x] == block && ir.insts[x].op != IR_PHI && defPos[x] > defPos[y])
+            return false;
+        const std::vector<std::pair<uint32_t, uint32_t>> &last = lastUse[block];
+        auto use = std::lower_bound(last.begin(), last.end(), std::make_pair(x, uint32_t(0)));
+        return contains(liveOut[block], x) || (use != last.end() && use->first == x && use->second > defPos[y]);
+    }
+    // Computes which values are live into and out of each block, and where
+    // in its block each value is last used
+    void computeLiveness()
+    {
+        size_t blocks = ir.blocks.size();
+        defBlock.assign(ir.insts.size(), UINT32_MAX);
+        defPos.assign(ir.insts.size(), 0);
+        lastUse.assign(blocks, {});
+        liveIn.assign(blocks, {});
+        liveOut.assign(blocks, {});
+        std::vector<std::vector<uint32_t>> exposed(blocks);
+        std::vector<uint32_t> evaluated;
+        for (uint32_t block : ir.layout)
+        {
+            const IrBlock &b = ir.blocks[block];
+            size_t count = b.insts.size();
+            // An inlined instruction reads its operands where its user is computed
+            evaluated.assign(count, 0);
+            for (size_t i = count; i-- > 0;)
+            {
+                uint32_t id = b.insts[i];
+                defBlock[id] = block;
+                defPos[id] = uint32_t(i);
+                evaluated[i] = !inlined[id] ? uint32_t(i) : userAt[id] == count ? uint32_t(count) : evaluated[userAt[id]];
+            }
+            std::vector<std::pair<uint32_t, uint32_t>> &last = lastUse[block];
+            auto use = [&](uint32_t v, uint32_t at)
+            {
+                if (!needsSlot(v))
+                    return;
+                last.emplace_back(v, at);
+                if (defBlock[v] != block)
+                    exposed[block].push_back(v);
+            };
+            for (size_t i = 0; i < count; i++)
+            {
+                const IrInst &inst = ir.insts[b.insts[i]];
+                if (inst.op != IR_PHI)
+                    for (size_t k = 0; k < IrProgram::operandCount(inst.op); k++)
+                        use(inst.args[k], evaluated[i]);
+            }
+            if (b.exit == EXIT_BRANCH || b.exit == EXIT_RETURN)
+                use(b.value, uint32_t(count));
+            std::sort(last.begin(), last.end(), [](auto l, auto r)
+                      { return l.first != r.first ? l.first < r.first : l.second > r.second; });
+            last.erase(std::unique(last.begin(), last.end(), [](auto l, auto r)
+                                   { return l.first == r.first; }),
+                       last.end());
+            std::sort(exposed[block].begin(), exposed[block].end());
+            exposed[block].erase(std::unique(exposed[block].begin(), exposed[block].end()), exposed[block].end());
+            liveIn[block] = exposed[block];
+        }
+        std::vector<uint32_t> out, merged;
+        for (bool again = true; again;)
+        {
+            again = false;
+            for (size_t n = ir.layout.size(); n-- > 0;)
+            {
+                uint32_t block = ir.layout[n];
+                const IrBlock &b = ir.blocks[block];
+                out.clear();
+                for (size_t i = 0; i < b.successors(); i++)
+                {
+                    const IrBlock &next = ir.blocks[b.targets[i]];
+                    out.insert(out.end(), liveIn[b.targets[i]].begin(), liveIn[b.targets[i]].end());
+                    size_t index = std::find(next.preds.begin(), next.preds.end(), block) - next.preds.begin();
+                    for (uint32_t id : next.insts)
+                        if (ir.insts[id].op == IR_PHI && needsSlot(ir.phiBegin(id)[index]))
+                            out.push_back(ir.phiBegin(id)[index]);
+                }
+                std::sort(out.begin(), out.end());
+                out.erase(std::unique(out.begin(), out.end()), out.end());
+                if (out == liveOut[block])
+                    continue;
+                liveOut[block] = out;
+                merged = exposed[block];
+                for (uint32_t v : out)
+                    if (defBlock[v] != block)
+                        merged.push_back(v);
+                std::sort(merged.begin(), merged.end());
+                merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+                liveIn[block].swap(merged);
+                again = true;
+            }
+        }
+    }
+    // Gives each phi and its operands one slot where their lifetimes do not
+    // overlap, so that the copy on the edge disappears. A loop variable's
+    // values then share a slot much as the variable does in the AST
+    // compiler, but copies stay where copy propagation made two values of a
+    // variable live at once.
+    void coalesce()
+    {
+        leader.resize(ir.insts.size());
+        for (uint32_t v = 0; v < leader.size(); v++)
+            leader[v] = v;
+        if (ir.layout.empty())
+            return;
+        computeLiveness();
+        std::vector<std::vector<uint32_t>> members(ir.insts.size());
+        auto membersOf = [&](uint32_t root) -> std::vector<uint32_t> &
+        {
+            if (members[root].empty())
+                members[root].push_back(root);
+            return members[root];
+        };
+        for (uint32_t block : ir.layout)
+            for (uint32_t phi : ir.blocks[block].insts)
+            {
+                if (ir.insts[phi].op != IR_PHI || !needsSlot(phi))
+                    continue;
+                for (const uint32_t *arg = ir.phiBegin(phi); arg != ir.phiEnd(phi); arg++)
+                {
+                    uint32_t a = find(*arg), p = find(phi);
+                    if (!needsSlot(*arg) || a == p)
+                        continue;
+                    std::vector<uint32_t> &left = membersOf(a), &right = membersOf(p);
+                    if (left.size() * right.size() > MAX_COALESCE_PAIRS)
+                        continue;
+                    bool overlap = false;
+                    for (size_t i = 0; i < left.size() && !overlap; i++)
+                        for (size_t j = 0; j < right.size() && !overlap; j++)
+                            overlap = liveAt(left[i], right[j]) || liveAt(right[j], left[i]);
+                    if (overlap)
+                        continue;
+                    leader[a] = p;
+                    right.insert(right.end(), left.begin(), left.end());
+                    std::vector<uint32_t>().swap(left);
+                }
+            }
+    }
+    void assignSlots()
+    {
+        slots.assign(ir.insts.size(), NO_SLOT);
+        uint32_t count = 0;
+        for (uint32_t block : ir.layout)
+            for (uint32_t id : ir.blocks[block].insts)
+                if (needsSlot(id) && find(id) == id)
+                    slots[id] = count++;
+        for (uint32_t block : ir.layout)
+            for (uint32_t id : ir.blocks[block].insts)
+                if (needsSlot(id))
+                    slots[id] = slots[find(id)];
+        out.bytecode.slots = count;
+    }
+
+    void pushConstant(int64_t value)
+    {
+        auto found = constants.find(value);
+        if (found == constants.end())
+            found = constants.emplace(value, uint32_t(out.constant(value))).first;
+        out.emit(OP_CONST, found->second);
+    }
+    // Pushes v, computing it here if it was inlined (or `compute` is set).
+    // Walks the tree of inlined operands with an explicit stack, since a
+    // long operator chain inlines into one deep tree.
+    void push(uint32_t v, bool compute = false)
+    {
+        work.push_back(Item{v, uint8_t(compute ? 2 : 0)});
+        while (!work.empty())
+        {
+            Item item = work.back();
+            work.pop_back();
+            const IrInst &inst = ir.insts[item.value];
+            if (item.state == 1)
+            {
+                out.offset = inst.offset;
+                if (inst.op == IR_BOOL)
+                    out.emit(OP_TO_BOOL);
+                else if (inst.op >= IR_ADD && inst.op <= IR_NEQ)
+                    out.emit(Opcode(inst.op - IR_ADD + OP_ADD));
+                continue; // a copy is its operand
+            }
+            if (inst.op == IR_CONST)
+                pushConstant(inst.value);
+            else if (item.state == 0 && !inlined[item.value])
+                out.emit(OP_LOAD, slots[item.value]);
+            else
+            {
+                work.push_back(Item{item.value, 1});
+                for (size_t i = IrProgram::operandCount(inst.op); i-- > 0;)
+                    work.push_back(Item{inst.args[i], 0});
+            }
+        }
+    }
+    // Sets the phis of `to` for the edge from `from`
+    void copyPhis(uint32_t from, uint32_t to)
+    {
+        const IrBlock &target = ir.blocks[to];
+        size_t index = std::find(target.preds.begin(), target.preds.end(), from) - target.preds.begin();
+        std::vector<uint32_t> stored;
+        for (uint32_t id : target.insts)
+            if (ir.insts[id].op == IR_PHI && slots[id] != NO_SLOT && slots[ir.phiBegin(id)[index]] != slots[id])
+            {
+                push(ir.phiBegin(id)[index]);
+                stored.push_back(id);
+            }
+        for (size_t i = stored.size(); i-- > 0;)
+            out.emit(OP_STORE, slots[stored[i]]);
+    }
+    void jumpTo(size_t jump, uint32_t from, uint32_t to)
+    {
+        if (hasPhis(to))
+            stubs.push_back(Stub{jump, from, to});
+        else
+            fixups.emplace_back(jump, to);
+    }
+    void block(uint32_t id, uint32_t next)
+    {
+        const IrBlock &b = ir.blocks[id];
+        blockCode[id] = out.label();
+        for (uint32_t inst : b.insts)
+        {
+            IrOp op = ir.insts[inst].op;
+            if (op == IR_PRINT)
+            {
+                push(ir.insts[inst].args[0]);
+                out.offset = ir.insts[inst].offset;
+                out.emit(OP_PRINT);
+            }
+            else if (op != IR_PHI && slots[inst] != NO_SLOT)
+            {
+                push(inst, true);
+                out.emit(OP_STORE, slots[inst]);
+            }
+        }
+        switch (b.exit)
+        {
+        case EXIT_JUMP:
+            copyPhis(id, b.targets[0]);
+            if (b.targets[0] != next)
+                fixups.emplace_back(out.emit(OP_JUMP), b.targets[0]);
+            break;
+        case EXIT_BRANCH:
+            push(b.value);
+            jumpTo(out.branchIfFalse(), id, b.targets[1]);
+            if (b.targets[0] != next || hasPhis(b.targets[0]))
+                jumpTo(out.emit(OP_JUMP), id, b.targets[0]);
+            break;
+        case EXIT_RETURN:
+            push(b.value);
+            out.emit(OP_RETURN);
+            break;
+        case EXIT_HALT:
+            out.emit(OP_HALT);
+            break;
+        }
+    }
+
+public:
+    explicit IrCodegen(const IrProgram &ir) : ir(ir) {}
+
+    Bytecode generate(Diagnostics &diagnostics)
+    {
+        uses = ir.countUses();
+        chooseInlined();
+        coalesce();
+        assignSlots();
+        blockCode.assign(ir.blocks.size(), 0);
+        for (size_t i = 0; i < ir.layout.size(); i++)
+            block(ir.layout[i], i + 1 < ir.layout.size() ? ir.layout[i + 1] : UINT32_MAX);
+        for (const Stub &stub : stubs)
+        {
+            out.patch(stub.jump, out.label());
+            copyPhis(stub.from, stub.to);
+            fixups.emplace_back(out.emit(OP_JUMP), stub.to);
+        }
+        for (const auto &[jump, target] : fixups)
+            out.patch(jump, blockCode[target]);
+        return out.finish(diagnostics);
+    }
+};
+
+#endif
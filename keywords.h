@@ -0,0 +1,94 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Keyword tables for the lexers in frontend.h, one per dialect.
+template <typename Type>
+struct Keyword
+{
+    std::string_view text{};
+    Type type{};
+};
+
+// Perfect hash over a fixed keyword set, generated at compile time.
+//
+// A word is hashed from its length, first and last character with a
+// multiplicative seed; the constructor searches for a seed under which no
+// two keywords share a slot. Classifying a word then costs a length check,
+// one multiply, one table load and at most one compare, whatever the size of
+// the keyword set. If no seed works (two keywords with the same length,
+// first and last character) the table fails to build at compile time.
+template <typename Type, size_t N>
+class KeywordTable
+{
+private:
+    static constexpr unsigned BITS = N <= 8 ? 4 : N <= 16 ? 5 : N <= 32 ? 6 : 7;
+    static constexpr size_t SIZE = size_t(1) << BITS;
+    static_assert(N * 2 <= SIZE, "keyword set too large for the table");
+
+    Keyword<Type> slots[SIZE];
+    uint32_t seed;
+    size_t minLength;
+    size_t maxLength;
+
+    static constexpr size_t hash(std::string_view word, uint32_t seed)
+    {
+        uint32_t key = uint32_t((unsigned char)word[0]) |
+                       uint32_t((unsigned char)word[word.size() - 1]) << 8 |
+                       uint32_t(word.size()) << 16;
+        return uint32_t(key * seed) >> (32 - BITS);
+    }
+
+public:
+    constexpr KeywordTable(const Keyword<Type> (&keywords)[N])
+        : slots(), seed(0), minLength(SIZE_MAX), maxLength(0)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            if (keywords[i].text.size() < minLength)
+                minLength = keywords[i].text.size();
+            if (keywords[i].text.size() > maxLength)
+                maxLength = keywords[i].text.size();
+        }
+        for (uint32_t candidate = 0x9E3779B1u; seed == 0; candidate += 2)
+        {
+            bool used[SIZE] = {};
+            bool ok = true;
+            for (size_t i = 0; i < N && ok; i++)
+            {
+                size_t slot = hash(keywords[i].text, candidate);
+                ok = !used[slot];
+                used[slot] = true;
+            }
+            if (ok)
+                seed = candidate;
+            if (candidate == 0x9E3779B1u + 2 * 100000)
+                throw "no perfect hash seed for this keyword set";
+        }
+        for (size_t i = 0; i < N; i++)
+            slots[hash(keywords[i].text, seed)] = keywords[i];
+    }
+
+    // Returns the keyword's type, or `otherwise` if word is not a keyword
+    constexpr Type lookup(std::string_view word, Type otherwise) const
+    {
+        if (word.size() < minLength || word.size() > maxLength)
+            return otherwise;
+        const Keyword<Type> &slot = slots[hash(word, seed)];
+        return slot.text == word ? slot.type : otherwise;
+    }
+    // Returns the keyword spelled as `type`, or an empty view if there is
+    // none. A scan of the table, meant for printing rather than lexing.
+    constexpr std::string_view spelling(Type type) const
+    {
+        for (const Keyword<Type> &slot : slots)
+            if (!slot.text.empty() && slot.type == type)
+                return slot.text;
+        return {};
+    }
+};
+
+#endif
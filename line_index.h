@@ -0,0 +1,52 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+// Offsets at which each source line starts, recorded by the lexer as it
+// steps over newlines. Any source offset maps to its line and column with
+// a binary search, so tokens and AST nodes only need to carry offsets.
+class LineIndex
+{
+private:
+    std::vector<size_t> starts; // starts[i] is the offset of line i + 1
+
+public:
+    struct Location
+    {
+        size_t line;   // 1-based
+        size_t column; // 1-based, in bytes
+    };
+
+    LineIndex() : starts(1, 0) {}
+    // Records that a new line starts at `offset` (one past a '\n').
+    // Offsets must be added in increasing order.
+    void addLine(size_t offset) { starts.push_back(offset); }
+    // Appends the lines of an index built over a slice of the source that
+    // starts at `base`, which must lie past every line added so far
+    void append(const LineIndex &slice, size_t base)
+    {
+        for (size_t i = 1; i < slice.starts.size(); i++)
+            starts.push_back(slice.starts[i] + base);
+    }
+    size_t lineCount() const { return starts.size(); }
+    const std::vector<size_t> &lineStarts() const { return starts; }
+    void clear() { starts.assign(1, 0); }
+
+    Location locate(size_t offset) const
+    {
+        size_t line = std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin();
+        return Location{line, offset - starts[line - 1] + 1};
+    }
+};
+
+// Prints "<line>, column <column>", to follow "on line " in diagnostics
+inline std::ostream &operator<<(std::ostream &out, const LineIndex::Location &location)
+{
+    return out << location.line << ", column " << location.column;
+}
+
+#endif
@@ -1,246 +1,93 @@
 #include <iostream>
-#include <vector>
+#include <sstream>
 #include <string>
-#include <cctype>
-#include <map>
+#include <string_view>
+#include "bench.h"
+#include "frontend.h"
+#include "syntaxes.h"
 
 using namespace std;
 
-enum TokenType {
-    T_INT, T_ID, T_NUM, T_IF, T_ELSE, T_RETURN,
-    T_ASSIGN, T_PLUS, T_MINUS, T_MUL, T_DIV,
-    T_LPAREN, T_RPAREN, T_LBRACE, T_RBRACE,
-    T_SEMICOLON, T_GT, T_EOF,
-};
-
-struct Token {
-    TokenType type;
-    string value;
-};
-
-class Lexer {
-private:
-    string src; // source code
-    size_t pos; // current position in code
-    size_t line; // current line number
-
-public:
-    Lexer(const string &src) : src(src), pos(0), line(1) {}
-
-    vector<Token> tokenize() {
-        vector<Token> tokens;
-        while (pos < src.size()) {
-            char current = src[pos];
-
-            if (isspace(current)) {
-                if (current == '\n') {
-                    line++; // Increment line number on new line
-                }
-                pos++;
-                continue;
-            }
-            if (isdigit(current)) {
-                tokens.push_back(Token{T_NUM, consumeNumber()});
-                continue;
-            }
-            if (isalpha(current)) {
-                string word = consumeWord();
-                if (word == "int") tokens.push_back(Token{T_INT, word});
-                else if (word == "if") tokens.push_back(Token{T_IF, word});
-                else if (word == "else") tokens.push_back(Token{T_ELSE, word});
-                else if (word == "return") tokens.push_back(Token{T_RETURN, word});
-                else tokens.push_back(Token{T_ID, word});
-                continue;
-            }
-
-            switch (current) {
-                case '=': tokens.push_back(Token{T_ASSIGN, "="}); break;
-                case '+': tokens.push_back(Token{T_PLUS, "+"}); break;
-                case '-': tokens.push_back(Token{T_MINUS, "-"}); break;
-                case '*': tokens.push_back(Token{T_MUL, "*"}); break;
-                case '/': tokens.push_back(Token{T_DIV, "/"}); break;
-                case '(': tokens.push_back(Token{T_LPAREN, "("}); break;
-                case ')': tokens.push_back(Token{T_RPAREN, ")"}); break;
-                case '{': tokens.push_back(Token{T_LBRACE, "{"}); break;
-                case '}': tokens.push_back(Token{T_RBRACE, "}"}); break;
-                case ';': tokens.push_back(Token{T_SEMICOLON, ";"}); break;
-                case '>': tokens.push_back(Token{T_GT, ">"}); break;
-                default: 
-                    cout << "Unexpected character: " << current << " on line " << line << endl; 
-                    exit(1);
-            }
-            pos++;
-        }
-        tokens.push_back(Token{T_EOF, ""});
-        return tokens;
-    }
-
-    string consumeNumber() {
-        size_t start = pos;
-        while (pos < src.size() && isdigit(src[pos])) pos++;
-        return src.substr(start, pos - start);
-    }
-
-    string consumeWord() {
-        size_t start = pos;
-        while (pos < src.size() && isalnum(src[pos])) pos++;
-        return src.substr(start, pos - start);
-    }
-};
-
-class Parser {
-public:
-    Parser(const vector<Token> &tokens) : tokens(tokens), pos(0) {}
-
-    void parseProgram() {
-        while (tokens[pos].type != T_EOF) {
-            parseStatement();
-        }
-        cout << "Parsing completed successfully! No Syntax Error" << endl;
-    }
-
-private:
-    vector<Token> tokens;
-    size_t pos;
-
-    void parseStatement() {
-        if (tokens[pos].type == T_INT) {
-            parseDeclaration();
-        } else if (tokens[pos].type == T_ID) {
-            parseAssignment();
-        } else if (tokens[pos].type == T_IF) {
-            parseIfStatement();
-        } else if (tokens[pos].type == T_RETURN) {
-            parseReturnStatement();
-        } else if (tokens[pos].type == T_LBRACE) {
-            parseBlock();
-        } else {
-            cout << "Syntax error: unexpected token " << tokens[pos].value 
-                 << " on line " << getLineNumber(pos) << endl;
-            exit(1);
-        }
-    }
-
-    void expect(TokenType type) {
-        if (tokens[pos].type == type) {
-            pos++;
-        } else {
-            cout << "Syntax error: expected " << tokenTypeToString(type) 
-                 << " but found " << tokens[pos].value 
-                 << " on line " << getLineNumber(pos) << endl;
-            exit(1);
-        }
-    }
-
-    size_t getLineNumber(size_t index) {
-        size_t line = 1;
-        for (size_t i = 0; i < index; ++i) {
-            if (tokens[i].value == "\n") {
-                line++;
-            }
-        }
-        return line;
-    }
-
-    string tokenTypeToString(TokenType type) {
-        switch (type) {
-            case T_INT: return "T_INT";
-            case T_ID: return "T_ID";
-            case T_NUM: return "T_NUM";
-            case T_IF: return "T_IF";
-            case T_ELSE: return "T_ELSE";
-            case T_RETURN: return "T_RETURN";
-            case T_ASSIGN: return "T_ASSIGN";
-            case T_PLUS: return "T_PLUS";
-            case T_MINUS: return "T_MINUS";
-            case T_MUL: return "T_MUL";
-            case T_DIV: return "T_DIV";
-            case T_LPAREN: return "T_LPAREN";
-            case T_RPAREN: return "T_RPAREN";
-            case T_LBRACE: return "T_LBRACE";
-            case T_RBRACE: return "T_RBRACE";
-            case T_SEMICOLON: return "T_SEMICOLON";
-            case T_GT: return "T_GT";
-            case T_EOF: return "T_EOF";
-            default: return "UNKNOWN";
-        }
-    }
-
-    void parseBlock() {
-        expect(T_LBRACE);
-        while (tokens[pos].type != T_RBRACE && tokens[pos].type != T_EOF) {
-            parseStatement();
-        }
-        expect(T_RBRACE);
-    }
-
-    void parseDeclaration() {
-        expect(T_INT);
-        expect(T_ID);
-        expect(T_SEMICOLON);
-    }
-
-    void parseAssignment() {
-        expect(T_ID);
-        expect(T_ASSIGN);
-        parseExpression();
-        expect(T_SEMICOLON);
-    }
-
-    void parseIfStatement() {
-        expect(T_IF);
-        expect(T_LPAREN);
-        parseExpression();
-        expect(T_RPAREN);
-        parseStatement();
-        if (tokens[pos].type == T_ELSE) {
-            expect(T_ELSE);
-            parseStatement();
-        }
-    }
-
-    void parseReturnStatement() {
-        expect(T_RETURN);
-        parseExpression();
-        expect(T_SEMICOLON);
-    }
-
-    void parseExpression() {
-        parseTerm();
-        while (tokens[pos].type == T_PLUS || tokens[pos].type == T_MINUS) {
-            pos++;
-            parseTerm();
-        }
-        if (tokens[pos].type == T_GT) {
-            pos++;
-            parseExpression();
-        }
-    }
+using Lexer = BasicLexer<LineNumberSyntax>;
+using Parser = BasicParser<LineNumberSyntax, PackedCursor>;
+
+// What the benchmark generator may emit for this parser
+const Dialect benchDialect = {LineNumberSyntax::name, {"int"}, "if", {"+", "-", "*", "/"}, {">"}, false, false,
+                              {}, {}};
+
+// Times lexing and parsing separately on a generated program
+int runBenchmark(const BenchOptions &options) {
+    string src = ProgramGenerator(benchDialect, options).generate();
+    if (options.emit) {
+        cout << src;
+        return 0;
+    }
+    PackedTokens tokens;
+    LineIndex lines;
+    Diagnostics diagnostics;
+    SymbolPool symbols;
+    Arena arena;
+    double lexTime = bestTime(options.repeat, [&] {
+        lines.clear();
+        symbols.clear();
+        Lexer(src, lines, diagnostics, symbols).tokenizePacked(tokens);
+    });
+    double parseTime = bestTime(options.repeat, [&] {
+        arena.reset();
+        diagnostics.clear();
+        Parser(PackedCursor(tokens, src, lines, symbols), arena, diagnostics).parseProgram();
+    });
+    if (!diagnostics.empty()) {
+        cout << "Error: the generated program does not parse" << endl;
+        diagnostics.print(cout, lines);
+        return 1;
+    }
+    printBenchHeader(cout, benchDialect, options, src.size(), tokens.size() - 1);
+    printBenchPhase(cout, "lex", src.size(), tokens.size() - 1, lexTime);
+    printBenchPhase(cout, "parse", src.size(), tokens.size() - 1, parseTime);
+    benchKeywords(cout, src, lineNumberKeywords, LineNumberSyntax::keywords, T_ID, options.repeat);
+    return 0;
+}
 
-    void parseTerm() {
-        parseFactor();
-        while (tokens[pos].type == T_MUL || tokens[pos].type == T_DIV) {
-            pos++;
-            parseFactor();
-        }
-    }
+// Checks that lexing, parsing, printing the tree and reporting errors stay
+// linear on adversarial inputs (see runComplexity)
+int runComplexityCheck(const BenchOptions &options) {
+    // The buffers are reused from run to run, as a long-lived driver would,
+    // so the best of the repeats times the front end and not page faults
+    PackedTokens tokens;
+    LineIndex lines;
+    Diagnostics diagnostics;
+    SymbolPool symbols;
+    Arena arena;
+    return runComplexity(cout, benchDialect, options, [&](const string &src) {
+        lines.clear();
+        diagnostics.clear();
+        symbols.clear();
+        arena.reset();
+        Lexer(src, lines, diagnostics, symbols).tokenizePacked(tokens);
+        Stmt *program = Parser(PackedCursor(tokens, src, lines, symbols), arena, diagnostics).parseProgram();
+        DiscardStream sink;
+        dumpStmts<LineNumberSyntax>(program, sink);
+        diagnostics.print(sink, lines);
+    });
+}
 
-    void parseFactor() {
-        if (tokens[pos].type == T_NUM || tokens[pos].type == T_ID) {
-            pos++;
-        } else if (tokens[pos].type == T_LPAREN) {
-            expect(T_LPAREN);
-            parseExpression();
-            expect(T_RPAREN);
-        } else {
-            cout << "Syntax error: unexpected token " << tokens[pos].value 
-                 << " on line " << getLineNumber(pos) << endl;
-            exit(1);
-        }
-    }
-};
+int main(int argc, char *argv[]) {
+    // --bench times the lexer and parser on a generated program instead of
+    // parsing the built-in example (see parseBenchOption for its options).
+    // --complexity checks that adversarial inputs of growing size (--size
+    // sets the largest) take no more than linear time.
+    bool bench = false;
+    bool complexity = false;
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "--bench") bench = true;
+        else if (string(argv[i]) == "--complexity") complexity = true;
+        else parseBenchOption(argc, argv, i, options);
+    }
+    if (bench) return runBenchmark(options);
+    if (complexity) return runComplexityCheck(options);
 
-int main() {
     string input = R"(
         int a;
         a = 5;
@@ -256,11 +103,18 @@ int main() {
         }
     )";
 
-    Lexer lexer(input);
-    vector<Token> tokens = lexer.tokenize();
-
-    Parser parser(tokens);
-    parser.parseProgram();
+    PackedTokens tokens;
+    LineIndex lines;
+    Diagnostics diagnostics;
+    SymbolPool symbols;
+    Arena arena;
+    Lexer(input, lines, diagnostics, symbols).tokenizePacked(tokens);
+    Parser(PackedCursor(tokens, input, lines, symbols), arena, diagnostics).parseProgram();
+    if (!diagnostics.empty()) {
+        diagnostics.print(cout, lines);
+        return 1;
+    }
+    cout << "Parsing completed successfully! No Syntax Error" << endl;
 
     return 0;
 }
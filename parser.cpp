@@ -1,563 +1,1856 @@
-#include <map>
-#include <string>
-#include <vector>
-#include <fstream>
-#include <iostream>
-#include <cctype>
-using namespace std;
-enum TokenType
-{
-    T_ID,
-    T_LT,
-    T_NEQ,
-    T_MUL,
-    T_EQ,
-    T_LE,
-    T_ASSIGN,
-    T_GT,
-    T_INT,
-    T_EOF,
-    T_FLOAT, //float data type
-    T_AND,
-    T_DIV,
-    T_RETURN,
-    // T_IF,
-    T_AGAR,
-    T_NUM,
-    T_ELSE,
-    T_PLUS,
-    T_MINUS,
-    T_LPAREN,
-    T_RPAREN,
-    T_LBRACE,
-    T_RBRACE,
-    T_STRING, //string data type
-    T_SEMICOLON,
-    // extra additions
-    T_AND_OP,
-    T_OR_OP,
-    T_BREAK,
-    T_CONTINUE,
-    T_BOOL,
-    T_TRUE,
-    T_FALSE,
-    T_PRINT,
-    // loops
-    T_WHILE,
-    T_FOR
-};
-string tokenTypeToString(TokenType type)
-{
-    switch (type)
-    {
-        // loops
-    case T_WHILE:
-        return "T_WHILE";
-    case T_FOR:
-        return "T_FOR";
-    case T_AGAR:
-        return "T_AGAR";
-    // case T_IF:
-    //     return "T_IF";
-    case T_ID:
-        return "T_ID";
-    case T_EQ:
-        return "T_EQ";
-    case T_LE:
-        return "T_LE";
-    case T_LT:
-        return "T_LT";
-    case T_AND_OP:
-        return "T_AND_OP";
-    case T_OR_OP:
-        return "T_OR_OP";
-    case T_GT:
-        return "T_GT";
-    case T_INT:
-        return "T_INT";
-    case T_EOF:
-        return "T_EOF";
-    case T_AND:
-        return "T_AND";
-    case T_MUL:
-        return "T_MUL";
-    case T_DIV:
-        return "T_DIV";
-    case T_NUM:
-        return "T_NUM";
-    case T_ELSE:
-        return "T_ELSE";
-    case T_PLUS:
-        return "T_PLUS";
-    case T_MINUS:
-        return "T_MINUS";
-    case T_FLOAT:
-        return "T_FLOAT";
-    case T_RETURN:
-        return "T_RETURN";
-    case T_ASSIGN:
-        return "T_ASSIGN";
-    case T_LPAREN:
-        return "T_LPAREN";
-    case T_RPAREN:
-        return "T_RPAREN";
-    case T_LBRACE:
-        return "T_LBRACE";
-    case T_RBRACE:
-        return "T_RBRACE";
-    case T_STRING:
-        return "T_STRING";
-    case T_SEMICOLON:
-        return "T_SEMICOLON";
-    case T_BREAK:
-        return "T_BREAK";
-    case T_CONTINUE:
-        return "T_CONTINUE";
-    case T_BOOL:
-        return "T_BOOL";
-    case T_TRUE:
-        return "T_TRUE";
-    case T_FALSE:
-        return "T_FALSE";
-    case T_PRINT:
-        return "T_PRINT";
-    default:
-        return "Unknown Token";
-    };
-}
-
-struct Token
-{
-    TokenType type;
-    string value;
-    int line; // for storing line number
-};
-
-class Lexer
-{
-private:
-    string src;
-    size_t pos;
-    int line;
-
-public:
-    Lexer(const string &src)
-    {
-        this->src = src;
-        this->pos = 0;
-        this->line = 1;
-    }
-    void advance()
-    {
-        if (src[pos] == '\n')
-            // Increment line number on newline
-            line++;
-        pos++;
-    }
-    string consumeNumber()
-    {
-        size_t start = pos;
-        while (isdigit(peek()))
-            advance();
-        return src.substr(start, pos - start);
-    }
-
-    string consumeWord()
-    {
-        size_t start = pos;
-        while (pos < src.size() && isalnum(src[pos]))
-            pos++;
-        return src.substr(start, pos - start);
-    }
-    char peek() const
-    {
-        return pos < src.size() ? src[pos] : '\0';
-    }
-    vector<Token> tokenize()
-    {
-        vector<Token> tokens;
-        while (pos < src.size())
-        {
-            char current = src[pos];
-            if (isspace(current))
-            {
-                advance();
-                continue;
-            }
-            else if (isdigit(current))
-            {
-                tokens.push_back(Token{T_NUM, consumeNumber(), line});
-                continue;
-            }
-            else if (isalpha(current))
-            {
-                string word = consumeWord();
-                if (word == "int")
-                    tokens.push_back(Token{TokenType::T_INT, word, line});
-                // else if (word == "if")
-                //     tokens.push_back(Token{TokenType::T_IF, word, line});
-                else if (word == "agar")
-                    tokens.push_back(Token{TokenType::T_AGAR, word, line});
-                else if (word == "else")
-                    tokens.push_back(Token{TokenType::T_ELSE, word, line});
-                else if (word == "return")
-                    tokens.push_back(Token{TokenType::T_RETURN, word, line});
-                else if (word == "break")
-                    tokens.push_back(Token{TokenType::T_BREAK, word, line});
-                else if (word == "continue")
-                    tokens.push_back(Token{TokenType::T_CONTINUE, word, line});
-                else if (word == "true")
-                    tokens.push_back(Token{TokenType::T_TRUE, word, line});
-                else if (word == "false")
-                    tokens.push_back(Token{TokenType::T_FALSE, word, line});
-                else if (word == "print")
-                    tokens.push_back(Token{TokenType::T_PRINT, word, line});
-                else if (word == "while")
-                    tokens.push_back(Token{TokenType::T_WHILE, word, line});
-                else if (word == "for")
-                    tokens.push_back(Token{TokenType::T_FOR, word, line});
-                else
-                    tokens.push_back(Token{TokenType::T_ID, word, line});
-                continue;
-            }
-            // Handle symbols and operators
-            switch (current)
-            {
-            case '+':
-                tokens.push_back(Token{TokenType::T_PLUS, "+", line});
-                break;
-            case '-':
-                tokens.push_back(Token{TokenType::T_MINUS, "-", line});
-                break;
-            case '*':
-                tokens.push_back(Token{TokenType::T_MUL, "*", line});
-                break;
-            case '/':
-                tokens.push_back(Token{TokenType::T_DIV, "/", line});
-                break;
-            case '=':
-                advance();
-                if (peek() == '=')
-                {
-                    tokens.push_back(Token{T_EQ, "==", line});
-                    advance();
-                }
-                else
-                {
-                    tokens.push_back(Token{T_ASSIGN, "=", line});
-                }
-                break;
-            case '<':
-                if (pos + 1 < src.size() && src[pos + 1] == '=')
-                {
-                    tokens.push_back(Token{TokenType::T_LE, "<=", line});
-                    pos++;
-                }
-                else
-                {
-                    tokens.push_back(Token{TokenType::T_LT, "<", line}); // Handle '<'
-                }
-                break;
-            case '>':
-                tokens.push_back(Token{TokenType::T_GT, ">"});
-                break;
-            case '!':
-                if (pos + 1 < src.size() && src[pos + 1] == '=')
-                {
-                    tokens.push_back(Token{TokenType::T_NEQ, "!="}); // Handle '!='
-                    pos++;
-                }
-                break;
-            case '&':
-                if (pos + 1 < src.size() && src[pos + 1] == '&')
-                {
-                    tokens.push_back(Token{TokenType::T_AND_OP, "&&"}); // Handle '&&'
-                    pos++;
-                }
-                break;
-            case '|':
-                if (pos + 1 < src.size() && src[pos + 1] == '|')
-                {
-                    tokens.push_back(Token{TokenType::T_OR_OP, "||", line}); // Handle '||'
-                    pos++;
-                }
-                break;
-            case '(':
-                tokens.push_back(Token{TokenType::T_LPAREN, "(", line});
-                break;
-            case ')':
-                tokens.push_back(Token{TokenType::T_RPAREN, ")", line});
-                break;
-            case '{':
-                tokens.push_back(Token{TokenType::T_LBRACE, "{", line});
-                break;
-            case '}':
-                tokens.push_back(Token{TokenType::T_RBRACE, "}", line});
-                break;
-            case ';':
-                tokens.push_back(Token{TokenType::T_SEMICOLON, ";", line});
-                break;
-            default:
-                cout << "Unexpected character: " << current << "on line" << line << endl;
-                break;
-            }
-            pos++;
-        }
-        tokens.push_back(Token{TokenType::T_EOF, "EOF", line});
-        return tokens;
-    }
-};
-
-class Parser
-{
-private:
-    vector<Token> tokens;
-    size_t pos;
-
-public:
-    Parser(vector<Token> &tokens)
-    {
-        this->tokens = tokens;
-        this->pos = 0;
-    }
-    Token peek() const
-    {
-        return pos < tokens.size() ? tokens[pos] : Token{T_EOF, "EOF", -1};
-    }
-    void parseStatement()
-    {
-        if (tokens[pos].type == T_INT)
-        {
-            parseDeclaration();
-        }
-        else if (tokens[pos].type == T_ID)
-        {
-            parseAssignment();
-        }
-        else if (tokens[pos].type == T_WHILE)
-        {
-            parseWhileStatement();
-        }
-        else if (tokens[pos].type == T_FOR)
-        {
-            parseForStatement();
-        }
-        else if (tokens[pos].type == T_AGAR)
-        {
-            parseIfStatement();
-        }
-        // else if (tokens[pos].type == T_IF)
-        // {
-        //     parseIfStatement();
-        // }
-        else if (tokens[pos].type == T_RETURN)
-        {
-            parseReturnStatement();
-        }
-        else if (tokens[pos].type == T_LBRACE)
-        {
-            parseBlock();
-        }
-        else if (tokens[pos].type == T_BREAK)
-        {
-            expect(T_BREAK);
-            expect(T_SEMICOLON);
-        }
-        else if (tokens[pos].type == T_CONTINUE)
-        {
-            expect(T_CONTINUE);
-            expect(T_SEMICOLON);
-        }
-        else if (tokens[pos].type == T_PRINT)
-        {
-            expect(T_PRINT);
-            expect(T_LPAREN);
-            parseExpression();
-            expect(T_RPAREN);
-            expect(T_SEMICOLON);
-        }
-        else if (tokens[pos].type == T_LBRACE)
-        {
-            parseBlock();
-        }
-        else
-        {
-            cout << "Syntax error: unexpected token " << tokens[pos].value << "on line no " << tokens[pos].line << endl;
-            exit(1);
-        }
-    }
-    void parseProgram()
-    {
-        while (peek().type != T_EOF)
-        {
-            parseStatement();
-        }
-        cout << "Parsing completed successfully! No Syntax Error" << endl;
-    }
-    void parseBlock()
-    {
-        expect(T_LBRACE);
-        while (peek().type != T_RBRACE && peek().type != T_EOF)
-        {
-            parseStatement();
-        }
-        expect(T_RBRACE);
-    }
-    void parseDeclaration()
-    {
-        expect(T_INT);
-        expect(T_ID);
-        expect(T_SEMICOLON);
-    }
-    void parseAssignment()
-    {
-        expect(T_ID);
-        expect(T_ASSIGN);
-        parseExpression();
-        expect(T_SEMICOLON);
-    }
-    void parseWhileStatement()
-    {
-        expect(T_WHILE);
-        expect(T_LPAREN);
-        parseExpression();
-        expect(T_RPAREN);
-        parseStatement();
-    }
-    void parseForStatement()
-    {
-        expect(T_FOR);
-        expect(T_LPAREN);
-        parseAssignment();
-        expect(T_SEMICOLON);
-        parseExpression();
-        expect(T_SEMICOLON);
-        parseAssignment();
-        expect(T_RPAREN);
-        parseStatement();
-    }
-
-    void parseIfStatement()
-    {
-        expect(T_AGAR);
-        // expect(T_IF);
-        expect(T_LPAREN);
-        parseExpression();
-        expect(T_RPAREN);
-        parseStatement();
-        if (peek().type == T_ELSE)
-        {
-            expect(T_ELSE);
-            parseStatement();
-        }
-    }
-    void parseReturnStatement()
-    {
-        expect(T_RETURN);
-        parseExpression();
-        expect(T_SEMICOLON);
-    }
-    void parseExpression()
-    {
-        // Check for a number, identifier, or left parenthesis
-        if (tokens[pos].type == T_NUM || tokens[pos].type == T_ID)
-        {
-            pos++;
-        }
-        else if (tokens[pos].type == T_LPAREN)
-        {
-            expect(T_LPAREN);
-            parseExpression();
-            expect(T_RPAREN);
-        }
-        else
-        {
-            cout << "Syntax error: expected a number, identifier, or '(' but found " << tokens[pos].value << " on line " << tokens[pos].line << endl;
-            exit(1);
-        }
-        parseComparison();
-    }
-
-    void parseComparison()
-    {
-        parseTerm();
-        while (peek().type == T_GT || peek().type == T_LT || peek().type == T_EQ || peek().type == T_NEQ)
-        {
-            pos++; // Consume comparison operator
-            parseTerm();
-        }
-    }
-    void parseLogicalExpression()
-    {
-        parseComparison();
-        while (peek().type == T_AND_OP || peek().type == T_OR_OP)
-        {
-            pos++; // Consume logical operator (&& or ||)
-            parseComparison();
-        }
-    }
-
-    void parseTerm()
-    {
-        parseFactor();
-        while (peek().type == T_PLUS || peek().type == T_MINUS)
-        {
-            pos++;
-            parseFactor();
-        }
-    }
-    void parseFactor()
-    {
-        if (peek().type == T_NUM || peek().type == T_ID)
-        {
-            pos++; // Consume numbers or identifiers
-        }
-        else if (peek().type == T_LPAREN)
-        {
-            expect(T_LPAREN);
-            parseExpression();
-            expect(T_RPAREN); // Ensure matching parentheses
-        }
-        else
-        {
-            cout << "Syntax error: unexpected token '" << peek().value << "' on line " << peek().line << endl;
-            exit(1);
-        }
-    }
-    void expect(TokenType type)
-    {
-        if (peek().type == type)
-        {
-            pos++;
-        }
-        else
-        {
-            cout << "Syntax error: " << tokenTypeToString(type) << " but found '" << peek().value << "' on line " << peek().line << endl;
-            exit(1);
-        }
-    }
-};
-int main(int argc, char *argv[])
-{
-    if (argc < 2)
-    {
-        cout << "Provide a file" << endl;
-        return 1;
-    }
-
-    ifstream file(argv[1]);
-    if (!file)
-    {
-        cout << "Error: Unable to open file " << argv[1] << endl;
-        return 1;
-    }
-
-    string sourceCode((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
-    file.close();
-
-    Lexer lexer(sourceCode);
-    vector<Token> tokens = lexer.tokenize();
-    Parser parser(tokens);
-    parser.parseProgram();
-    return 0;
-}
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "ast_format.h"
+#include "bench.h"
+#include "frontend.h"
+#include "hash.h"
+#include "ir.h"
+#include "syntaxes.h"
+#include "vm.h"
+using namespace std;
+
+using Lexer = BasicLexer<AgarSyntax>;
+template <typename Cursor>
+using Parser = BasicParser<AgarSyntax, Cursor>;
+
+// Read-only view of an input file. Regular files are mmapped so the lexer
+// runs directly over the mapped pages; pipes, ttys and other non-regular
+// files fall back to being read into an owned buffer.
+class SourceFile
+{
+private:
+    const char *data;
+    size_t size;
+    bool mapped;
+    string buffer;
+
+public:
+    SourceFile() : data(nullptr), size(0), mapped(false) {}
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+    ~SourceFile()
+    {
+        if (mapped)
+            munmap(const_cast<char *>(data), size);
+    }
+    bool open(const char *path)
+    {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                madvise(p, st.st_size, MADV_SEQUENTIAL);
+                data = static_cast<const char *>(p);
+                size = st.st_size;
+                mapped = true;
+                close(fd);
+                return true;
+            }
+        }
+        // Not mappable: read it the slow way
+        char chunk[65536];
+        ssize_t n;
+        while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+            buffer.append(chunk, n);
+        close(fd);
+        return n == 0;
+    }
+    string_view view() const
+    {
+        return mapped ? string_view(data, size) : string_view(buffer);
+    }
+};
+
+
+// Runs task(worker, index) for every index in [0, count) across `threads`
+// threads. Each worker starts with a contiguous share of the indices in its
+// own deque, takes work from the back of it, and once it runs dry steals
+// from the front of the other workers' deques.
+class WorkStealingPool
+{
+private:
+    struct Queue
+    {
+        mutex lock;
+        deque<size_t> items;
+    };
+    vector<Queue> queues;
+
+    bool popLocal(unsigned worker, size_t &index)
+    {
+        Queue &queue = queues[worker];
+        lock_guard<mutex> guard(queue.lock);
+        if (queue.items.empty())
+            return false;
+        index = queue.items.back();
+        queue.items.pop_back();
+        return true;
+    }
+    bool steal(unsigned thief, size_t &index)
+    {
+        for (size_t i = 1; i < queues.size(); i++)
+        {
+            Queue &victim = queues[(thief + i) % queues.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.items.empty())
+            {
+                index = victim.items.front();
+                victim.items.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    WorkStealingPool(unsigned threads) : queues(max(threads, 1u)) {}
+
+    template <typename Task>
+    void run(size_t count, Task task)
+    {
+        size_t threads = queues.size();
+        for (size_t i = 0; i < threads; i++)
+            for (size_t index = count * i / threads; index < count * (i + 1) / threads; index++)
+                queues[i].items.push_back(index);
+        // Tasks never add work, so a worker that finds every queue empty is done
+        auto work = [&](unsigned worker)
+        {
+            size_t index;
+            while (popLocal(worker, index) || steal(worker, index))
+                task(worker, index);
+        };
+        vector<thread> pool;
+        for (unsigned i = 1; i < threads; i++)
+            pool.emplace_back(work, i);
+        work(0);
+        for (thread &t : pool)
+            t.join();
+    }
+};
+
+// Brace or parenthesis depth over a run of tokens, clamped at 0 as the
+// parser sees it: a stray '}' at the top level is skipped and a stray ')'
+// ends its statement. A run takes a depth d to max(d + shift, floor), and
+// two runs compose into another such pair, so a run can be summarized once
+// and applied to whatever depth it turns out to start at.
+struct ClampedDepth
+{
+    long shift = 0, floor = 0;
+    void step(long change)
+    {
+        shift += change;
+        floor = max(floor + change, 0L);
+    }
+    long apply(long depth) const { return max(depth + shift, floor); }
+};
+
+struct BracketDepths
+{
+    ClampedDepth braces, parens;
+    void step(uint8_t kind)
+    {
+        braces.step(kind == T_LBRACE ? 1 : kind == T_RBRACE ? -1 : 0);
+        parens.step(kind == T_LPAREN ? 1 : kind == T_RPAREN ? -1 : 0);
+    }
+};
+
+// Everything needed to lex and parse one source. A session is reused from
+// one parse to the next (one per thread in batch mode), so the arena,
+// token and line buffers keep their memory instead of reallocating it.
+struct ParseSession
+{
+    Arena arena;
+    Diagnostics diagnostics;
+    LineIndex lines;
+    PackedTokens tokens;
+    SymbolPool symbols;
+    vector<unique_ptr<Arena>> chunkArenas; // one per chunk of a parallel parse
+    size_t depthLimit = DEFAULT_DEPTH_LIMIT;
+
+    // Parses src, returning its first top-level statement. The result and
+    // the diagnostics stay valid until the next call.
+    Stmt *parse(string_view src, bool packed)
+    {
+        arena.reset();
+        diagnostics.clear();
+        lines.clear();
+        symbols.clear();
+        Lexer lexer(src, lines, diagnostics, symbols);
+        if (packed && src.size() < UINT32_MAX)
+        {
+            lexer.tokenizePacked(tokens);
+            Parser<PackedCursor> parser(PackedCursor(tokens, src, lines, symbols), arena, diagnostics, depthLimit);
+            return parser.parseProgram();
+        }
+        Parser<LexerCursor<Lexer>> parser(LexerCursor<Lexer>(lexer), arena, diagnostics, depthLimit);
+        return parser.parseProgram();
+    }
+    // Parses the packed tokens already in `tokens` (say, from a ParseCache)
+    // without lexing src again
+    Stmt *parseTokens(string_view src)
+    {
+        arena.reset();
+        Diagnostics ignored; // the cached diagnostics already include these
+        Parser<PackedCursor> parser(PackedCursor(tokens, src, lines, symbols), arena, ignored, depthLimit);
+        return parser.parseProgram();
+    }
+    // Parses src (below 4 GB) on `threads` threads, with the same result as
+    // parse(src, true).
+    //  1. The source is cut at whitespace into slices that are lexed in
+    //     parallel, each into its own symbol pool, and stitched into one
+    //     packed stream with the symbols renumbered into the session's pool.
+    //  2. A parallel scan of brace and parenthesis depth, each clamped at 0
+    //     (see ClampedDepth; so a stray '}' does not leave the rest looking
+    //     unnested), finds the top-level statement
+    //     boundaries: both depths 0 after a ';' or '}' not followed by 'else'.
+    //  3. The statements are split at boundaries into chunks of roughly
+    //     equal token count, parsed independently, and their ASTs and
+    //     diagnostics joined back in source order.
+    //  4. Error recovery can run across a boundary, so if any chunk reports
+    //     an error in its first or last statement, the whole stream is
+    //     parsed again on this thread instead.
+    Stmt *parseParallel(string_view src, unsigned threads)
+    {
+        arena.reset();
+        diagnostics.clear();
+        lines.clear();
+        symbols.clear();
+        threads = max(threads, 1u);
+        size_t slices = threads * 4; // oversplit so stealing can even out the load
+        WorkStealingPool pool(threads);
+
+        vector<size_t> cuts(slices + 1, src.size());
+        cuts[0] = 0;
+        for (size_t i = 1; i < slices; i++)
+        {
+            size_t cut = max(cuts[i - 1], src.size() * i / slices);
+            while (cut < src.size() && !isSpaceChar(src[cut]))
+                cut++;
+            cuts[i] = cut;
+        }
+        vector<PackedTokens> sliceTokens(slices);
+        vector<LineIndex> sliceLines(slices);
+        vector<Diagnostics> sliceDiagnostics(slices);
+        vector<SymbolPool> sliceSymbols(slices);
+        pool.run(slices, [&](unsigned, size_t i)
+                 {
+            Lexer lexer(src.substr(cuts[i], cuts[i + 1] - cuts[i]), sliceLines[i], sliceDiagnostics[i], sliceSymbols[i]);
+            lexer.tokenizePacked(sliceTokens[i]); });
+        // Only each slice's distinct names go through the shared pool, so
+        // this serial step is small next to the lexing
+        vector<vector<uint32_t>> renumber(slices);
+        for (size_t i = 0; i < slices; i++)
+            for (size_t id = 0; id < sliceSymbols[i].size(); id++)
+                renumber[i].push_back(symbols.intern(sliceSymbols[i].name(id)));
+
+        // Each slice ends in its own T_EOF, which is dropped when stitching
+        vector<size_t> firstToken(slices + 1, 0);
+        for (size_t i = 0; i < slices; i++)
+            firstToken[i + 1] = firstToken[i] + sliceTokens[i].size() - 1;
+        size_t count = firstToken[slices];
+        tokens.resize(count + 1);
+        pool.run(slices, [&](unsigned, size_t i)
+                 {
+            const PackedTokens &slice = sliceTokens[i];
+            for (size_t j = 0; j + 1 < slice.size(); j++)
+            {
+                tokens.kinds[firstToken[i] + j] = slice.kinds[j];
+                tokens.offsets[firstToken[i] + j] = slice.offsets[j] + cuts[i];
+                tokens.lengths[firstToken[i] + j] = slice.kinds[j] == T_ID ? renumber[i][slice.lengths[j]] : slice.lengths[j];
+            } });
+        tokens.kinds[count] = T_EOF;
+        tokens.offsets[count] = src.size();
+        tokens.lengths[count] = 0;
+        for (size_t i = 0; i < slices; i++)
+        {
+            lines.append(sliceLines[i], cuts[i]);
+            diagnostics.append(sliceDiagnostics[i], cuts[i]);
+        }
+
+        // Each block of tokens is summarized in parallel, and the depth
+        // before every block follows from a short serial scan over the
+        // summaries
+        auto blockBegin = [&](size_t block)
+        { return count * block / slices; };
+        vector<BracketDepths> blockDepths(slices);
+        pool.run(slices, [&](unsigned, size_t block)
+                 {
+            for (size_t i = blockBegin(block); i < blockBegin(block + 1); i++)
+                blockDepths[block].step(tokens.kinds[i]); });
+        vector<long> bracesBefore(slices + 1, 0), parensBefore(slices + 1, 0);
+        for (size_t block = 0; block < slices; block++)
+        {
+            bracesBefore[block + 1] = blockDepths[block].braces.apply(bracesBefore[block]);
+            parensBefore[block + 1] = blockDepths[block].parens.apply(parensBefore[block]);
+        }
+        vector<vector<size_t>> blockSplits(slices);
+        pool.run(slices, [&](unsigned, size_t block)
+                 {
+            long braces = bracesBefore[block], parens = parensBefore[block];
+            for (size_t i = blockBegin(block); i < blockBegin(block + 1); i++)
+            {
+                uint8_t kind = tokens.kinds[i];
+                braces = max(braces + (kind == T_LBRACE ? 1 : kind == T_RBRACE ? -1 : 0), 0L);
+                parens = max(parens + (kind == T_LPAREN ? 1 : kind == T_RPAREN ? -1 : 0), 0L);
+                if (braces == 0 && parens == 0 && (kind == T_SEMICOLON || kind == T_RBRACE) && i + 1 < count &&
+                    tokens.kinds[i + 1] != T_ELSE)
+                    blockSplits[block].push_back(i + 1);
+            } });
+        vector<size_t> splits;
+        for (const vector<size_t> &found : blockSplits)
+            splits.insert(splits.end(), found.begin(), found.end());
+
+        vector<size_t> bounds(1, 0);
+        for (size_t chunk = 1; chunk < slices; chunk++)
+        {
+            auto split = lower_bound(splits.begin(), splits.end(), count * chunk / slices);
+            if (split != splits.end() && *split > bounds.back())
+                bounds.push_back(*split);
+        }
+        bounds.push_back(count);
+
+        size_t chunks = bounds.size() - 1;
+        while (chunkArenas.size() < chunks)
+            chunkArenas.push_back(make_unique<Arena>());
+        vector<Diagnostics> chunkDiagnostics(chunks);
+        vector<Stmt *> heads(chunks);
+        pool.run(chunks, [&](unsigned, size_t chunk)
+                 {
+            Arena &chunkArena = *chunkArenas[chunk];
+            chunkArena.reset();
+            Parser<PackedCursor> parser(PackedCursor(tokens, src, lines, symbols, bounds[chunk], bounds[chunk + 1]),
+                                        chunkArena, chunkDiagnostics[chunk], depthLimit);
+            heads[chunk] = parser.parseProgram(); });
+
+        // An error in the first statement of a chunk may belong to recovery
+        // that started before it, and one in the last may have recovered
+        // past its end; chunks at the ends of the input have no such edge
+        bool nearEdge = false;
+        for (size_t chunk = 0; chunk < chunks && !nearEdge; chunk++)
+        {
+            auto after = upper_bound(splits.begin(), splits.end(), bounds[chunk]);
+            auto before = lower_bound(splits.begin(), splits.end(), bounds[chunk + 1]);
+            size_t firstEnd = after == splits.end() ? count : min(*after, bounds[chunk + 1]);
+            size_t lastBegin = before == splits.begin() ? 0 : max(*(before - 1), bounds[chunk]);
+            for (const Diagnostic &diagnostic : chunkDiagnostics[chunk].all())
+                if ((chunk > 0 && diagnostic.offset < tokens.offsets[firstEnd]) ||
+                    (chunk + 1 < chunks && diagnostic.offset >= tokens.offsets[lastBegin]))
+                    nearEdge = true;
+        }
+        if (nearEdge)
+        {
+            Parser<PackedCursor> parser(PackedCursor(tokens, src, lines, symbols), arena, diagnostics, depthLimit);
+            return parser.parseProgram();
+        }
+
+        Stmt *first = nullptr;
+        Stmt **tail = &first;
+        for (size_t chunk = 0; chunk < chunks; chunk++)
+        {
+            *tail = heads[chunk];
+            while (*tail != nullptr)
+                tail = &(*tail)->next;
+            diagnostics.append(chunkDiagnostics[chunk], 0);
+        }
+        return first;
+    }
+    // Prints the diagnostics followed by an error count
+    void report(ostream &out)
+    {
+        diagnostics.print(out, lines);
+        out << diagnostics.size() << (diagnostics.size() == 1 ? " error" : " errors") << " found\n";
+    }
+};
+
+// On-disk cache of parse results, keyed by content. An entry holds the
+// packed tokens, line starts, symbols and diagnostics of one source text, in a file
+// named after the XXH64 of the text (seeded with the dialect and nesting
+// limit, which also decide the result). A hit costs a hash and a read
+// instead of a lex and a parse; the tokens are there for when the AST is
+// wanted after all.
+//
+// Entry layout, in native byte order: a CacheHeader, then the token kinds
+// (uint8), offsets and lengths (uint32), the line starts (uint64), each
+// symbol name as a uint32 length and its bytes in ID order, and each
+// diagnostic as a uint64 offset, uint32 length and its message bytes. An
+// entry is used only if its header matches the source and its payload
+// checksum is right; anything else is a miss, and the entry is rewritten.
+class ParseCache
+{
+private:
+    static constexpr char MAGIC[8] = {'P', 'A', 'R', 'S', 'E', 'C', 'A', 'C'};
+    static const uint32_t VERSION = 3;
+    struct CacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t key;
+        uint64_t sourceSize;
+        uint64_t tokens;
+        uint64_t lines;
+        uint64_t symbols;
+        uint64_t diagnostics;
+        uint64_t payloadSize;
+        uint64_t checksum; // XXH64 of the payload
+    };
+    string dir;
+    uint64_t seed; // from the dialect and the nesting limit
+
+    uint64_t keyOf(string_view src) const { return hashBytes(src, seed); }
+    string pathOf(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.cache", (unsigned long long)key);
+        return dir + "/" + name;
+    }
+    template <typename T>
+    static void put(string &out, const T &value)
+    {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+    template <typename T>
+    static void putArray(string &out, const vector<T> &values, size_t count)
+    {
+        out.append(reinterpret_cast<const char *>(values.data()), count * sizeof(T));
+    }
+    // Reads a T at p, which must leave it within end
+    template <typename T>
+    static bool take(const char *&p, const char *end, T &value)
+    {
+        if (size_t(end - p) < sizeof(T))
+            return false;
+        memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+    template <typename T>
+    static bool takeArray(const char *&p, const char *end, vector<T> &values, size_t count)
+    {
+        if (size_t(end - p) / sizeof(T) < count)
+            return false;
+        values.resize(count);
+        memcpy(values.data(), p, count * sizeof(T));
+        p += count * sizeof(T);
+        return true;
+    }
+
+public:
+    ParseCache(string dir, size_t depthLimit) : dir(std::move(dir))
+    {
+        seed = hashBytes(string(AgarSyntax::name) + "/" + to_string(VERSION) + "/" + to_string(depthLimit));
+        error_code ignored;
+        filesystem::create_directories(this->dir, ignored);
+    }
+
+    // Fills the session's tokens, lines, symbols and diagnostics from the entry for
+    // src, or returns false if there is no valid one
+    bool load(string_view src, ParseSession &session) const
+    {
+        uint64_t key = keyOf(src);
+        SourceFile file;
+        if (!file.open(pathOf(key).c_str()))
+            return false;
+        string_view entry = file.view();
+        const char *p = entry.data(), *end = p + entry.size();
+        CacheHeader header;
+        if (!take(p, end, header) || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+            header.key != key || header.sourceSize != src.size() || header.tokens == 0 ||
+            header.payloadSize != size_t(end - p) || hashBytes(string_view(p, end - p)) != header.checksum)
+            return false;
+
+        PackedTokens &tokens = session.tokens;
+        vector<uint64_t> starts;
+        if (!takeArray(p, end, tokens.kinds, header.tokens) || !takeArray(p, end, tokens.offsets, header.tokens) ||
+            !takeArray(p, end, tokens.lengths, header.tokens) || !takeArray(p, end, starts, header.lines))
+            return false;
+        session.lines.clear();
+        for (size_t i = 1; i < starts.size(); i++)
+            session.lines.addLine(starts[i]);
+        session.symbols.clear();
+        for (uint64_t i = 0; i < header.symbols; i++)
+        {
+            uint32_t length;
+            if (!take(p, end, length) || size_t(end - p) < length ||
+                session.symbols.intern(string_view(p, length)) != i)
+                return false;
+            p += length;
+        }
+        for (size_t i = 0; i < header.tokens; i++)
+            if ((tokens.kinds[i] == T_ID && tokens.lengths[i] >= header.symbols) ||
+                tokens.end(i, session.symbols) > src.size())
+                return false;
+        session.diagnostics.clear();
+        for (uint64_t i = 0; i < header.diagnostics; i++)
+        {
+            uint64_t offset;
+            uint32_t length;
+            if (!take(p, end, offset) || !take(p, end, length) || size_t(end - p) < length)
+                return false;
+            session.diagnostics.report(offset, string(p, length));
+            p += length;
+        }
+        return p == end;
+    }
+    // Writes the session's result for src, which must have been parsed in
+    // packed mode. The entry is written to a private temporary file and
+    // renamed into place, so concurrent writers and readers only ever see
+    // whole entries.
+    void store(string_view src, ParseSession &session) const
+    {
+        if (src.size() >= UINT32_MAX) // too big for packed tokens
+            return;
+        const PackedTokens &tokens = session.tokens;
+        const vector<size_t> &starts = session.lines.lineStarts();
+        session.diagnostics.sort();
+        string payload;
+        payload.reserve(tokens.size() * 9 + starts.size() * 8);
+        putArray(payload, tokens.kinds, tokens.size());
+        putArray(payload, tokens.offsets, tokens.size());
+        putArray(payload, tokens.lengths, tokens.size());
+        for (size_t start : starts)
+            put(payload, uint64_t(start));
+        for (size_t id = 0; id < session.symbols.size(); id++)
+        {
+            put(payload, uint32_t(session.symbols.name(id).size()));
+            payload += session.symbols.name(id);
+        }
+        for (const Diagnostic &diagnostic : session.diagnostics.all())
+        {
+            put(payload, uint64_t(diagnostic.offset));
+            put(payload, uint32_t(diagnostic.message.size()));
+            payload += diagnostic.message;
+        }
+
+        CacheHeader header = {};
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.key = keyOf(src);
+        header.sourceSize = src.size();
+        header.tokens = tokens.size();
+        header.lines = starts.size();
+        header.symbols = session.symbols.size();
+        header.diagnostics = session.diagnostics.size();
+        header.payloadSize = payload.size();
+        header.checksum = hashBytes(payload);
+
+        string path = pathOf(header.key);
+        ostringstream suffix;
+        suffix << ".tmp." << getpid() << '.' << this_thread::get_id();
+        string temporary = path + suffix.str();
+        {
+            ofstream out(temporary, ios::binary);
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            out.write(payload.data(), payload.size());
+            if (!out)
+            {
+                out.close();
+                unlink(temporary.c_str());
+                return;
+            }
+        }
+        if (rename(temporary.c_str(), path.c_str()) != 0)
+            unlink(temporary.c_str());
+    }
+};
+
+// A source buffer that stays parsed across edits, for editor integrations.
+//
+// The text is held as a sequence of segments, each a run of whole top-level
+// statements of roughly SEGMENT_SIZE bytes (or one larger statement) with
+// its own copy of the text, AST, arena and diagnostics. An edit relexes only
+// the segments it touches, extending the damaged range forward until it ends
+// on a top-level statement boundary again (and back one segment if it now
+// starts with 'else'), then re-splits and reparses just that range. The
+// segments it extends over are stepped through by their bracket summaries,
+// not relexed, so each byte past the touched segments is lexed and parsed
+// once. All segments intern into one symbol pool, which only grows, so a
+// name has the same ID throughout the document and across edits.
+//
+// Top-level statements are the unit because they are the smallest one that
+// parses on its own to the tree the whole document gives: inside a block,
+// what a '}' or 'else' means depends on everything enclosing it. The work
+// per edit follows the size of the edit and its enclosing top-level
+// statements, except when an edit leaves a '{' or '(' unclosed. That moves
+// everything up to where it closes into one statement, often the rest of
+// the document, and every edit inside it until it closes reparses all of
+// it. No parse that matches a full one can do less, and it is bounded by
+// about one lex and parse of the document from the edit on, no more than
+// a full parse. The only other whole-document step is shifting the start
+// offsets of the segments that follow.
+class IncrementalDocument
+{
+private:
+    static const size_t SEGMENT_SIZE = 4096;
+    struct Segment
+    {
+        string text;
+        size_t start; // offset of the segment in the document
+        Arena arena{4096};
+        Diagnostics diagnostics; // offsets relative to the segment
+        LineIndex lines;         // relative to the segment
+        Stmt *program;
+        // How the segment's tokens move the bracket depths, and its last
+        // token (T_EOF if it has none), so an edit before it can step over
+        // it without relexing it
+        BracketDepths depths;
+        uint8_t lastKind = T_EOF;
+    };
+    // Segments are never moved once built: their ASTs point into their text
+    vector<unique_ptr<Segment>> segments;
+    SymbolPool symbols;
+    PackedTokens scratch;
+    // Bytes the last edit ran through the lexer: the touched segments once to
+    // find statement boundaries and once more to parse them, and the
+    // segments stepped over after them only to parse them
+    size_t lexed;
+
+    // Index of the segment containing offset (the last one at the very end)
+    size_t segmentAt(size_t offset) const
+    {
+        auto it = upper_bound(segments.begin(), segments.end(), offset, [](size_t offset, const unique_ptr<Segment> &segment)
+                              { return offset < segment->start; });
+        return it == segments.begin() ? 0 : it - segments.begin() - 1;
+    }
+    // Bracket nesting as the parser sees it. A stray '}' at the top level is
+    // skipped and a stray ')' ends its statement, so neither count goes
+    // below zero. With both at zero, a ';' or '}' ends a top-level
+    // statement; '(' keeps the semicolons of a for header out of that.
+    struct Nesting
+    {
+        size_t braces = 0, parens = 0;
+        void step(uint8_t kind)
+        {
+            if (kind == T_LBRACE)
+                braces++;
+            else if (kind == T_RBRACE && braces > 0)
+                braces--;
+            else if (kind == T_LPAREN)
+                parens++;
+            else if (kind == T_RPAREN && parens > 0)
+                parens--;
+        }
+        void step(const BracketDepths &depths)
+        {
+            braces = depths.braces.apply(long(braces));
+            parens = depths.parens.apply(long(parens));
+        }
+        bool endsStatement(uint8_t kind) const
+        {
+            return braces == 0 && parens == 0 && (kind == T_SEMICOLON || kind == T_RBRACE);
+        }
+    };
+    // Lexes text, appending its tokens (without the final T_EOF) to `tokens`
+    // and tracking their nesting
+    void lexAppend(string_view text, PackedTokens &tokens, Nesting &nesting)
+    {
+        LineIndex lines;
+        Diagnostics ignored;
+        Lexer lexer(text, lines, ignored, symbols);
+        lexed += text.size();
+        for (Token token = lexer.next(); token.type != T_EOF; token = lexer.next())
+        {
+            tokens.push(token.type, token.value.data() - text.data(),
+                        token.type == T_ID ? token.symbol : token.value.size());
+            nesting.step(token.type);
+        }
+    }
+    unique_ptr<Segment> parseSegment(string text, size_t start)
+    {
+        unique_ptr<Segment> segment = make_unique<Segment>();
+        segment->text = std::move(text);
+        segment->start = start;
+        Lexer lexer(segment->text, segment->lines, segment->diagnostics, symbols);
+        lexer.tokenizePacked(scratch);
+        lexed += segment->text.size();
+        for (size_t i = 0; i + 1 < scratch.size(); i++)
+        {
+            segment->depths.step(scratch.kinds[i]);
+            segment->lastKind = scratch.kinds[i];
+        }
+        Parser<PackedCursor> parser(PackedCursor(scratch, segment->text, segment->lines, symbols), segment->arena,
+                                    segment->diagnostics);
+        segment->program = parser.parseProgram();
+        return segment;
+    }
+
+public:
+    IncrementalDocument(string_view text) : lexed(0)
+    {
+        edit(0, 0, text);
+    }
+    size_t size() const
+    {
+        return segments.empty() ? 0 : segments.back()->start + segments.back()->text.size();
+    }
+    string text() const
+    {
+        string text;
+        for (const unique_ptr<Segment> &segment : segments)
+            text += segment->text;
+        return text;
+    }
+    size_t lastLexedBytes() const { return lexed; }
+
+    // Replaces `removed` bytes at `offset` with `inserted`
+    void edit(size_t offset, size_t removed, string_view inserted)
+    {
+        offset = min(offset, size());
+        removed = min(removed, size() - offset);
+        // An edit at the very start of a segment may still extend the
+        // statement before it (say, by adding an else branch)
+        size_t first = segments.empty() ? 0 : segmentAt(offset > 0 ? offset - 1 : 0);
+        size_t last = segments.empty() ? 0 : segmentAt(offset + removed) + 1;
+        string work;
+        PackedTokens tokens;
+        Nesting nesting;
+        lexed = 0;
+        while (true)
+        {
+            size_t base = first < segments.size() ? segments[first]->start : 0;
+            work.clear();
+            for (size_t i = first; i < last; i++)
+                work += segments[i]->text;
+            work.replace(offset - base, removed, inserted);
+            tokens.clear();
+            nesting = Nesting();
+            lexAppend(work, tokens, nesting);
+            if (first > 0 && tokens.size() > 0 && tokens.kinds[0] == T_ELSE)
+            {
+                first--;
+                continue;
+            }
+            // Pull in following segments until the damaged range closes on a
+            // top-level boundary. Each one started and ended on a boundary
+            // before the edit, so its summary and final token are all that
+            // need checking. Only the last one pulled in can hold a boundary
+            // before its end (once both depths reach 0 inside a segment they
+            // follow its old ones, so the range closes at its end), and
+            // that one joins the last piece whole, so none is lexed here.
+            uint8_t lastKind = tokens.size() > 0 ? tokens.kinds[tokens.size() - 1] : uint8_t(T_EOF);
+            while (last < segments.size() && tokens.size() > 0 && !nesting.endsStatement(lastKind))
+            {
+                nesting.step(segments[last]->depths);
+                if (segments[last]->lastKind != T_EOF)
+                    lastKind = segments[last]->lastKind;
+                work += segments[last]->text;
+                last++;
+            }
+            break;
+        }
+
+        // Re-split the damaged range at top-level boundaries among the
+        // tokens of the segments the edit touched
+        size_t start = first < segments.size() ? segments[first]->start : 0;
+        vector<unique_ptr<Segment>> rebuilt;
+        size_t cut = 0;
+        nesting = Nesting();
+        for (size_t i = 0; i < tokens.size(); i++)
+        {
+            uint8_t kind = tokens.kinds[i];
+            nesting.step(kind);
+            size_t end = tokens.end(i, symbols);
+            if (nesting.endsStatement(kind) && i + 1 < tokens.size() &&
+                tokens.kinds[i + 1] != T_ELSE && end - cut >= SEGMENT_SIZE)
+            {
+                rebuilt.push_back(parseSegment(work.substr(cut, end - cut), start + cut));
+                cut = end;
+            }
+        }
+        if (cut < work.size())
+            rebuilt.push_back(parseSegment(work.substr(cut), start + cut));
+
+        long delta = long(inserted.size()) - long(removed);
+        for (size_t i = last; i < segments.size(); i++)
+            segments[i]->start += delta;
+        segments.erase(segments.begin() + first, segments.begin() + last);
+        segments.insert(segments.begin() + first, make_move_iterator(rebuilt.begin()), make_move_iterator(rebuilt.end()));
+    }
+
+    size_t errorCount() const
+    {
+        size_t count = 0;
+        for (const unique_ptr<Segment> &segment : segments)
+            count += segment->diagnostics.size();
+        return count;
+    }
+    // Prints every diagnostic in document order with its line and column
+    void report(ostream &out)
+    {
+        size_t line = 1, column = 1; // where the current segment starts
+        for (const unique_ptr<Segment> &segment : segments)
+        {
+            segment->diagnostics.sort();
+            for (const Diagnostic &diagnostic : segment->diagnostics.all())
+            {
+                LineIndex::Location local = segment->lines.locate(diagnostic.offset);
+                LineIndex::Location location{line + local.line - 1, local.line == 1 ? column + local.column - 1 : local.column};
+                out << diagnostic.message << " on line " << location << '\n';
+            }
+            LineIndex::Location end = segment->lines.locate(segment->text.size());
+            column = end.line == 1 ? column + end.column - 1 : end.column;
+            line += end.line - 1;
+        }
+        out << errorCount() << (errorCount() == 1 ? " error" : " errors") << " found\n";
+    }
+    // Calls f(stmt) for every top-level statement in document order
+    template <typename F>
+    void forEachStatement(F f) const
+    {
+        for (const unique_ptr<Segment> &segment : segments)
+            for (const Stmt *stmt = segment->program; stmt != nullptr; stmt = stmt->next)
+                f(stmt);
+    }
+};
+
+// Expands batch arguments into a list of files: a directory contributes the
+// regular files under it (sorted), "@list" the paths listed one per line in
+// the file `list`, and anything else is taken as a file.
+vector<string> collectBatchInputs(const vector<string> &args)
+{
+    vector<string> files;
+    for (const string &arg : args)
+    {
+        error_code ec;
+        if (arg.size() > 1 && arg[0] == '@')
+        {
+            ifstream list(arg.substr(1));
+            if (!list)
+                files.push_back(arg); // reported as unreadable below
+            for (string line; getline(list, line);)
+                if (!line.empty())
+                    files.push_back(line);
+        }
+        else if (filesystem::is_directory(arg, ec))
+        {
+            vector<string> found;
+            for (auto it = filesystem::recursive_directory_iterator(arg, ec);
+                 it != filesystem::recursive_directory_iterator(); it.increment(ec))
+                if (it->is_regular_file(ec))
+                    found.push_back(it->path().string());
+            sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        }
+        else
+        {
+            files.push_back(arg);
+        }
+    }
+    return files;
+}
+
+// Parses many files concurrently and prints one result per file, in input
+// order, followed by totals. Returns the process exit status.
+int runBatch(const vector<string> &args, unsigned threads, bool packed, size_t depthLimit, const ParseCache *cache)
+{
+    struct FileResult
+    {
+        bool opened = false;
+        bool cached = false;
+        size_t bytes = 0;
+        size_t errors = 0;
+        string report; // diagnostics, only for files with errors
+    };
+    vector<string> files = collectBatchInputs(args);
+    vector<FileResult> results(files.size());
+    vector<ParseSession> sessions(max(threads, 1u));
+    for (ParseSession &session : sessions)
+        session.depthLimit = depthLimit;
+
+    auto start = chrono::steady_clock::now();
+    WorkStealingPool pool(threads);
+    pool.run(files.size(), [&](unsigned worker, size_t index)
+             {
+        FileResult &result = results[index];
+        SourceFile file;
+        if (!file.open(files[index].c_str()))
+            return;
+        ParseSession &session = sessions[worker];
+        result.cached = cache != nullptr && cache->load(file.view(), session);
+        if (!result.cached)
+        {
+            session.parse(file.view(), packed || cache != nullptr);
+            if (cache != nullptr)
+                cache->store(file.view(), session);
+        }
+        result.opened = true;
+        result.bytes = file.view().size();
+        result.errors = session.diagnostics.size();
+        if (result.errors != 0)
+        {
+            ostringstream out;
+            session.diagnostics.print(out, session.lines);
+            result.report = out.str();
+        } });
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t bytes = 0, failed = 0, cached = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        const FileResult &result = results[i];
+        bytes += result.bytes;
+        cached += result.cached;
+        if (!result.opened)
+            cout << files[i] << ": Error: Unable to open file\n";
+        else if (result.errors == 0)
+            cout << files[i] << ": ok\n";
+        else
+            cout << files[i] << ": " << result.errors << (result.errors == 1 ? " error" : " errors") << "\n"
+                 << result.report;
+        failed += !result.opened || result.errors != 0;
+    }
+    cout << files.size() << " files, " << failed << " failed, ";
+    if (cache != nullptr)
+        cout << cached << " cached, ";
+    cout << bytes << " bytes in " << seconds << " s ("
+         << bytes / 1e6 / seconds << " MB/s, " << files.size() / seconds << " files/s) on "
+         << max(threads, 1u) << " threads" << endl;
+    return failed == 0 ? 0 : 1;
+}
+
+// Applies OFFSET:LENGTH:TEXT edits to src one after another, reparsing
+// incrementally, then reports on the final text like a normal run
+int runEdits(string_view src, const vector<string> &edits, bool dumpAst)
+{
+    IncrementalDocument document(src);
+    for (const string &edit : edits)
+    {
+        size_t first = edit.find(':');
+        size_t second = first == string::npos ? string::npos : edit.find(':', first + 1);
+        if (second == string::npos)
+        {
+            cout << "Error: edits are OFFSET:LENGTH:TEXT, got " << edit << endl;
+            return 1;
+        }
+        document.edit(stoul(edit.substr(0, first)), stoul(edit.substr(first + 1, second - first - 1)),
+                      string_view(edit).substr(second + 1));
+        cout << "Edit " << edit << ": lexed " << document.lastLexedBytes() << " bytes of a "
+             << document.size() << "-byte document" << endl;
+    }
+    if (document.errorCount() != 0)
+    {
+        document.report(cout);
+        return 1;
+    }
+    cout << "Parsing completed successfully! No Syntax Error" << endl;
+    if (dumpAst)
+        document.forEachStatement([](const Stmt *stmt)
+                                  {
+            // dumpStmts prints a whole list, so detach the statement first
+            Stmt copy = *stmt;
+            copy.next = nullptr;
+            dumpStmts<AgarSyntax>(&copy, cout); });
+    return 0;
+}
+
+// Parse server protocol, over a Unix domain stream socket. A client sends
+// any number of requests on one connection:
+//   FILE <path>\n              parse the file at <path> (as the server sees it)
+//   SOURCE <length>\n<bytes>   parse the <length> bytes that follow
+// and gets back, for each, "OK <length>\n" or "FAIL <length>\n" followed by
+// <length> bytes of the output a normal run would print.
+class Connection
+{
+private:
+    int fd;
+    string buffer; // bytes read but not yet consumed
+    size_t pos;
+
+    bool fill()
+    {
+        if (pos == buffer.size())
+        {
+            buffer.clear();
+            pos = 0;
+        }
+        char chunk[65536];
+        ssize_t got;
+        do
+            got = ::read(fd, chunk, sizeof(chunk));
+        while (got < 0 && errno == EINTR);
+        if (got <= 0)
+            return false;
+        buffer.append(chunk, got);
+        return true;
+    }
+
+public:
+    explicit Connection(int fd) : fd(fd), pos(0) {}
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+    ~Connection() { close(fd); }
+
+    // Reads up to the next '\n', which is dropped; false at end of stream
+    bool readLine(string &line)
+    {
+        size_t newline;
+        while ((newline = buffer.find('\n', pos)) == string::npos)
+            if (!fill())
+                return false;
+        line.assign(buffer, pos, newline - pos);
+        pos = newline + 1;
+        return true;
+    }
+    bool readBytes(size_t count, string &out)
+    {
+        out.clear();
+        while (out.size() < count)
+        {
+            if (pos == buffer.size() && !fill())
+                return false;
+            size_t take = min(count - out.size(), buffer.size() - pos);
+            out.append(buffer, pos, take);
+            pos += take;
+        }
+        return true;
+    }
+    bool write(string_view data)
+    {
+        while (!data.empty())
+        {
+            // MSG_NOSIGNAL: a client that hung up is an error, not a SIGPIPE
+            ssize_t sent = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent <= 0)
+                return false;
+            data.remove_prefix(sent);
+        }
+        return true;
+    }
+};
+
+// Fills in a socket address for path, or returns false if it is too long
+bool socketAddress(const string &path, sockaddr_un &address)
+{
+    address = sockaddr_un();
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        return false;
+    path.copy(address.sun_path, path.size());
+    return true;
+}
+
+// Idle ParseSessions shared by the server's connections. A session keeps
+// its arena chunks and token buffers, so a warm server parses without
+// allocating; the pool only grows to the number of concurrent requests.
+// Every session it makes nests at most depthLimit levels.
+class SessionPool
+{
+private:
+    mutex lock;
+    vector<unique_ptr<ParseSession>> idle;
+    size_t depthLimit;
+
+public:
+    explicit SessionPool(size_t depthLimit) : depthLimit(depthLimit) {}
+    unique_ptr<ParseSession> acquire()
+    {
+        lock_guard<mutex> guard(lock);
+        if (idle.empty())
+        {
+            unique_ptr<ParseSession> session = make_unique<ParseSession>();
+            session->depthLimit = depthLimit;
+            return session;
+        }
+        unique_ptr<ParseSession> session = std::move(idle.back());
+        idle.pop_back();
+        return session;
+    }
+    void release(unique_ptr<ParseSession> session)
+    {
+        lock_guard<mutex> guard(lock);
+        idle.push_back(std::move(session));
+    }
+};
+
+// Answers requests on one client connection until it closes
+void serveConnection(int fd, SessionPool &pool, bool packed)
+{
+    Connection connection(fd);
+    string request, source;
+    while (connection.readLine(request))
+    {
+        bool ok = false;
+        ostringstream out;
+        SourceFile file;
+        string_view src;
+        bool loaded = false;
+        if (request.compare(0, 5, "FILE ") == 0)
+        {
+            loaded = file.open(request.c_str() + 5);
+            src = file.view();
+            if (!loaded)
+                out << "Error: Unable to open file " << request.substr(5) << '\n';
+        }
+        else if (request.compare(0, 7, "SOURCE ") == 0)
+        {
+            if (!connection.readBytes(strtoull(request.c_str() + 7, nullptr, 10), source))
+                return;
+            src = source;
+            loaded = true;
+        }
+        else
+        {
+            out << "Error: unknown request " << request << '\n';
+        }
+        if (loaded)
+        {
+            unique_ptr<ParseSession> session = pool.acquire();
+            session->parse(src, packed);
+            ok = session->diagnostics.empty();
+            if (ok)
+                out << "Parsing completed successfully! No Syntax Error\n";
+            else
+                session->report(out);
+            pool.release(std::move(session));
+        }
+        string body = out.str();
+        if (!connection.write((ok ? "OK " : "FAIL ") + to_string(body.size()) + "\n") || !connection.write(body))
+            return;
+    }
+}
+
+// Listens on the Unix socket at path until killed, one thread per client
+int runServer(const string &path, bool packed, size_t depthLimit)
+{
+    sockaddr_un address;
+    if (!socketAddress(path, address))
+    {
+        cout << "Error: socket path too long: " << path << endl;
+        return 1;
+    }
+    // Replace a stale socket from an earlier server, but nothing else
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            cout << "Error: " << path << " exists and is not a socket" << endl;
+            return 1;
+        }
+        unlink(path.c_str());
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0)
+    {
+        cout << "Error: unable to listen on " << path << endl;
+        return 1;
+    }
+    cout << "Listening on " << path << endl;
+    SessionPool pool(depthLimit);
+    while (true)
+    {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            cout << "Error: accept failed" << endl;
+            return 1;
+        }
+        thread(serveConnection, client, ref(pool), packed).detach();
+    }
+}
+
+// Sends each input to the server at path ("-" sends standard input as
+// source) and prints the answers. Returns 1 if any input failed to parse.
+int runClient(const string &path, const vector<string> &inputs)
+{
+    sockaddr_un address;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (!socketAddress(path, address) || fd < 0 ||
+        connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        cout << "Error: unable to connect to " << path << endl;
+        return 1;
+    }
+    Connection connection(fd);
+    bool failed = false;
+    string status, body;
+    for (const string &input : inputs)
+    {
+        bool sent;
+        if (input == "-")
+        {
+            string source((istreambuf_iterator<char>(cin)), istreambuf_iterator<char>());
+            sent = connection.write("SOURCE " + to_string(source.size()) + "\n") && connection.write(source);
+        }
+        else
+        {
+            // The server may run in another directory
+            sent = connection.write("FILE " + filesystem::absolute(input).string() + "\n");
+        }
+        size_t space;
+        if (!sent || !connection.readLine(status) || (space = status.find(' ')) == string::npos ||
+            !connection.readBytes(strtoull(status.c_str() + space + 1, nullptr, 10), body))
+        {
+            cout << "Error: lost connection to " << path << endl;
+            return 1;
+        }
+        if (inputs.size() > 1)
+            cout << input << ": ";
+        cout << body;
+        failed |= status.compare(0, space, "OK") != 0;
+    }
+    cout.flush();
+    return failed ? 1 : 0;
+}
+
+// What the benchmark generator may emit for this parser
+const Dialect benchDialect = {"parser.cpp", {"int"}, "agar", {"+", "-", "*", "/"}, {">", "<", "<=", "==", "!="},
+                              true, false, {"&&", "||"}, {}};
+
+// Times each phase on a generated program: tokenize() into a token vector,
+// the packed lexer alone, the parser alone over the packed tokens, and the
+// default streaming lex-and-parse
+int runBenchmark(const BenchOptions &options)
+{
+    string src = ProgramGenerator(benchDialect, options).generate();
+    if (options.emit)
+    {
+        cout << src;
+        return 0;
+    }
+    if (src.size() >= UINT32_MAX)
+    {
+        cout << "Error: the benchmark program must be under 4 GB" << endl;
+        return 1;
+    }
+    ParseSession session;
+    // A Token takes 24 bytes, so the token vector of a big input would not
+    // fit in memory next to everything else
+    bool tokenize = src.size() <= (size_t(256) << 20);
+    double tokenizeTime = !tokenize ? 0 : bestTime(options.repeat, [&]
+                                                   {
+        session.lines.clear();
+        session.symbols.clear();
+        Lexer lexer(src, session.lines, session.diagnostics, session.symbols);
+        vector<Token> tokens = lexer.tokenize(); });
+    double lexTime = bestTime(options.repeat, [&]
+                              {
+        session.lines.clear();
+        session.symbols.clear();
+        Lexer lexer(src, session.lines, session.diagnostics, session.symbols);
+        lexer.tokenizePacked(session.tokens); });
+    double parseTime = bestTime(options.repeat, [&]
+                                {
+        session.arena.reset();
+        session.diagnostics.clear();
+        Parser<PackedCursor> parser(PackedCursor(session.tokens, src, session.lines, session.symbols), session.arena,
+                                    session.diagnostics);
+        parser.parseProgram(); });
+    size_t tokens = session.tokens.size() - 1;
+    double streamTime = bestTime(options.repeat, [&]
+                                 { session.parse(src, false); });
+    if (!session.diagnostics.empty())
+    {
+        cout << "Error: the generated program does not parse" << endl;
+        session.report(cout);
+        return 1;
+    }
+    printBenchHeader(cout, benchDialect, options, src.size(), tokens);
+    if (tokenize)
+        printBenchPhase(cout, "tokenize", src.size(), tokens, tokenizeTime);
+    printBenchPhase(cout, "lex", src.size(), tokens, lexTime);
+    printBenchPhase(cout, "parse", src.size(), tokens, parseTime);
+    printBenchPhase(cout, "stream", src.size(), tokens, streamTime);
+    benchKeywords(cout, src, agarKeywords, AgarSyntax::keywords, T_ID, options.repeat);
+    return 0;
+}
+
+// Checks that parseParallel matches a sequential parse on erroneous input:
+// each round mutates the generated program at random (deleting bytes and
+// inserting brackets, operators and separators) and compares the printed
+// diagnostics and AST of both parses. Returns 1 on the first mismatch.
+int runParallelCheck(const BenchOptions &options, unsigned threads)
+{
+    const size_t ROUNDS = 10, MUTATIONS = 300;
+    const char inserted[] = "{}();=+x";
+    string program = ProgramGenerator(benchDialect, options).generate();
+    mt19937_64 random(options.seed);
+    ParseSession session;
+    size_t errors = 0;
+    for (size_t round = 0; round < ROUNDS; round++)
+    {
+        string src = program;
+        for (size_t i = 0; i < MUTATIONS; i++)
+        {
+            size_t at = random() % src.size();
+            if (random() % 2 == 0)
+                src.erase(at, 1 + random() % 8);
+            else
+                src.insert(at, 1, inserted[random() % (sizeof(inserted) - 1)]);
+        }
+        ostringstream sequential, parallel;
+        dumpStmts<AgarSyntax>(session.parse(src, true), sequential);
+        session.report(sequential);
+        errors += session.diagnostics.size();
+        dumpStmts<AgarSyntax>(session.parseParallel(src, threads), parallel);
+        session.report(parallel);
+        if (sequential.str() != parallel.str())
+        {
+            cout << "Error: round " << round << ": parallel and sequential parses differ" << endl;
+            return 1;
+        }
+    }
+    cout << ROUNDS << " mutated programs of " << program.size() << " bytes, " << errors / ROUNDS
+         << " errors each on average: parallel and sequential parses agree" << endl;
+    return 0;
+}
+
+// Loop-heavy programs the VM benchmark runs, each returning a checksum
+struct VmKernel
+{
+    const char *name;
+    const char *src;
+};
+const VmKernel vmKernels[] = {
+    {"sum", R"(
+        int i;
+        int s;
+        for (i = 0; i < 20000000; i = i + 1) {
+            s = s + i * 3 - i / 7;
+        }
+        return s;
+    )"},
+    {"primes", R"(
+        int n;
+        int d;
+        int prime;
+        int count;
+        for (n = 2; n < 60000; n = n + 1) {
+            prime = 1;
+            for (d = 2; d * d <= n; d = d + 1) {
+                agar (n - n / d * d == 0) {
+                    prime = 0;
+                    break;
+                }
+            }
+            count = count + prime;
+        }
+        return count;
+    )"},
+    {"collatz", R"(
+        int n;
+        int x;
+        int steps;
+        for (n = 1; n < 100000; n = n + 1) {
+            x = n;
+            while (x != 1) {
+                agar (x - x / 2 * 2 == 0) {
+                    x = x / 2;
+                } else {
+                    x = 3 * x + 1;
+                }
+                steps = steps + 1;
+            }
+        }
+        return steps;
+    )"},
+    {"fib", R"(
+        int i;
+        int a;
+        int b;
+        int t;
+        int hits;
+        b = 1;
+        for (i = 0; i < 5000000; i = i + 1) {
+            t = a + b;
+            a = b;
+            b = t - t / 1000000007 * 1000000007;
+            agar (b < 500000000 && i > 10 || b == 0) {
+                continue;
+            }
+            hits = hits + 1;
+        }
+        return hits;
+    )"},
+};
+
+// Compiles a parsed program to bytecode: straight from the AST, or through
+// the IR and the pipeline's passes if one is given
+Bytecode compileProgram(string_view src, const Stmt *program, ParseSession &session, IrPipeline *pipeline)
+{
+    if (pipeline == nullptr)
+        return BytecodeCompiler(src, session.symbols, session.diagnostics).compile(program);
+    IrProgram ir;
+    IrLowering(src, session.symbols, session.diagnostics, ir).lower(program);
+    if (!session.diagnostics.empty())
+        return Bytecode();
+    pipeline->run(ir);
+    return IrCodegen(ir).generate(session.diagnostics);
+}
+
+// Checks that every stage of the tool stays linear on adversarial inputs
+// (see runComplexity): lexing, parsing, printing the tree and reporting
+// errors, and, for the inputs that parse cleanly, compiling to bytecode both
+// straight from the tree and through the IR and its default passes
+int runComplexityCheck(const BenchOptions &options)
+{
+    // One session serves every run, as in batch mode, so the best of the
+    // repeats times the front end and not page faults
+    ParseSession session;
+    IrPipeline pipeline;
+    string unknownPass;
+    pipeline.select(DEFAULT_IR_PASSES, unknownPass);
+    return runComplexity(cout, benchDialect, options, [&](const string &src)
+                         {
+        Stmt *program = session.parse(src, false);
+        DiscardStream sink;
+        dumpStmts<AgarSyntax>(program, sink);
+        if (session.diagnostics.empty())
+        {
+            compileProgram(src, program, session, nullptr);
+            compileProgram(src, program, session, &pipeline);
+        }
+        session.report(sink); });
+}
+
+// Compiles and runs each kernel, reporting the instructions it executed and
+// how many the VM gets through per second
+int runVmBenchmark(const BenchOptions &options, IrPipeline *pipeline)
+{
+    cout << "parser.cpp VM: best of " << options.repeat << (pipeline != nullptr ? ", optimized" : "") << '\n';
+    for (const VmKernel &kernel : vmKernels)
+    {
+        ParseSession session;
+        Stmt *program = session.parse(kernel.src, true);
+        Bytecode bytecode;
+        if (session.diagnostics.empty())
+            bytecode = compileProgram(kernel.src, program, session, pipeline);
+        VirtualMachine vm;
+        int64_t result = 0;
+        double seconds = bestTime(options.repeat, [&]
+                                  { result = vm.run(bytecode, cout, session.diagnostics); });
+        if (!session.diagnostics.empty())
+        {
+            cout << "Error: the " << kernel.name << " kernel does not run" << endl;
+            session.report(cout);
+            return 1;
+        }
+        cout << left << setw(8) << kernel.name << right << fixed << setprecision(2) << setw(10) << seconds * 1e3
+             << " ms" << setw(12) << vm.instructions() << " instructions" << setw(10)
+             << vm.instructions() / 1e6 / seconds << " Minstr/s  (returned " << result << ")\n"
+             << defaultfloat;
+    }
+    cout.flush();
+    return 0;
+}
+
+// Compiles a parsed program to bytecode and runs it, printing what it prints
+// and then the value it returns
+int runProgram(string_view src, const Stmt *program, ParseSession &session, IrPipeline *pipeline)
+{
+    Bytecode bytecode = compileProgram(src, program, session, pipeline);
+    if (!session.diagnostics.empty())
+    {
+        session.report(cout);
+        return 1;
+    }
+    VirtualMachine vm;
+    int64_t result = vm.run(bytecode, cout, session.diagnostics);
+    if (!session.diagnostics.empty())
+    {
+        session.report(cout);
+        return 1;
+    }
+    cout << "Program returned " << result << endl;
+    return 0;
+}
+
+// Lowers a parsed program to IR and runs the pipeline's passes on it, then
+// prints the result and, with `stats`, how long lowering and each pass took
+// and what they left
+int runIr(string_view src, const Stmt *program, ParseSession &session, IrPipeline &pipeline, bool stats)
+{
+    IrProgram ir;
+    auto start = chrono::steady_clock::now();
+    IrLowering(src, session.symbols, session.diagnostics, ir).lower(program);
+    double lowerTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (!session.diagnostics.empty())
+    {
+        session.report(cout);
+        return 1;
+    }
+    size_t instructions = ir.instructionCount(), blocks = ir.layout.size();
+    pipeline.run(ir);
+    printIr(ir, cout);
+    if (stats)
+    {
+        auto row = [](const char *name, double seconds, size_t instructions, size_t blocks)
+        {
+            cout << left << setw(8) << name << right << fixed << setprecision(3) << setw(10) << seconds * 1e3
+                 << " ms" << setw(10) << instructions << " instructions" << setw(8) << blocks << " blocks\n"
+                 << defaultfloat;
+        };
+        row("lower", lowerTime, instructions, blocks);
+        for (const IrPipeline::Step &step : pipeline.results())
+            row(step.pass->name, step.seconds, step.instructions, step.blocks);
+    }
+    cout.flush();
+    return 0;
+}
+
+// Writes the parsed program to path in the binary format of ast_format.h,
+// for other processes to map instead of parsing src again
+bool saveAst(const string &path, string_view src, const Stmt *program, const SymbolPool &symbols)
+{
+    AstWriter writer;
+    if (!writer.build(AgarSyntax::name, src, program, symbols))
+    {
+        cout << "Error: the AST of " << src.size() << " bytes of source does not fit the AST format" << endl;
+        return false;
+    }
+    ofstream out(path, ios::binary);
+    writer.write(out);
+    if (!out)
+    {
+        cout << "Error: Unable to write " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+// Writes text as a JSON string literal
+void printJsonString(ostream &out, string_view text)
+{
+    out << '"';
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if ((unsigned char)c < 0x20)
+        {
+            const char *hex = "0123456789abcdef";
+            out << "\\u00" << hex[c >> 4] << hex[c & 15];
+        }
+        else
+            out << c;
+    }
+    out << '"';
+}
+
+// Parses path with every phase timed on its own (reading, packed lexing,
+// then parsing) and prints what it took, as text after the normal output or
+// as JSON in place of it. Reading touches every page of the mapping so the
+// lexer's time does not include the page faults.
+int runStats(const char *path, bool json, size_t depthLimit)
+{
+    struct Phase
+    {
+        const char *name;
+        double seconds;
+    };
+    auto now = [] { return chrono::steady_clock::now(); };
+    auto since = [&](chrono::steady_clock::time_point start)
+    { return chrono::duration<double>(now() - start).count(); };
+
+    auto start = now();
+    SourceFile file;
+    if (!file.open(path))
+    {
+        cout << "Error: Unable to open file " << path << endl;
+        return 1;
+    }
+    string_view src = file.view();
+    volatile char sink = 0;
+    for (size_t i = 0; i < src.size(); i += 4096)
+        sink = sink + src[i];
+    double readTime = since(start);
+
+    ParseSession session;
+    start = now();
+    Lexer lexer(src, session.lines, session.diagnostics, session.symbols);
+    lexer.tokenizePacked(session.tokens);
+    double lexTime = since(start);
+
+    start = now();
+    Parser<PackedCursor> parser(PackedCursor(session.tokens, src, session.lines, session.symbols), session.arena,
+                                session.diagnostics, depthLimit);
+    parser.parseProgram();
+    double parseTime = since(start);
+
+    size_t tokens = session.tokens.size() - 1; // without the final T_EOF
+    size_t kinds[256] = {};
+    for (size_t i = 0; i < tokens; i++)
+        kinds[session.tokens.kinds[i]]++;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    size_t peakRss = size_t(usage.ru_maxrss) * 1024; // ru_maxrss is in KB on Linux
+    const Phase phases[] = {{"read", readTime}, {"lex", lexTime}, {"parse", parseTime},
+                            {"total", readTime + lexTime + parseTime}};
+
+    if (json)
+    {
+        cout << "{\"file\": ";
+        printJsonString(cout, path);
+        cout << ", \"bytes\": " << src.size() << ", \"lines\": " << session.lines.lineCount()
+             << ", \"tokens\": " << tokens << ", \"symbols\": " << session.symbols.size()
+             << ", \"errors\": " << session.diagnostics.size() << ", \"phases\": {";
+        for (const Phase &phase : phases)
+            cout << (&phase == phases ? "" : ", ") << '"' << phase.name << "\": {\"seconds\": " << phase.seconds
+                 << ", \"bytes_per_second\": " << src.size() / phase.seconds
+                 << ", \"tokens_per_second\": " << tokens / phase.seconds << '}';
+        cout << "}, \"max_depth\": " << parser.maxDepth() << ", \"peak_rss_bytes\": " << peakRss
+             << ", \"token_kinds\": {";
+        bool first = true;
+        for (int kind = 0; kind < 256; kind++)
+            if (kinds[kind] != 0)
+            {
+                cout << (first ? "\"" : ", \"") << tokenTypeToString(TokenType(kind)) << "\": " << kinds[kind];
+                first = false;
+            }
+        cout << "}}" << endl;
+        return session.diagnostics.empty() ? 0 : 1;
+    }
+
+    if (session.diagnostics.empty())
+        cout << "Parsing completed successfully! No Syntax Error" << endl;
+    else
+        session.report(cout);
+    cout << "\nfile       " << path << "\nbytes      " << src.size() << "\nlines      " << session.lines.lineCount()
+         << "\ntokens     " << tokens << "\nsymbols    " << session.symbols.size() << "\nerrors     "
+         << session.diagnostics.size() << '\n';
+    for (const Phase &phase : phases)
+        printBenchPhase(cout, phase.name, src.size(), tokens, phase.seconds);
+    cout << "max depth  " << parser.maxDepth() << "\npeak RSS   " << peakRss / 1024 << " KB\ntoken kinds\n";
+    for (int kind = 0; kind < 256; kind++)
+        if (kinds[kind] != 0)
+            cout << "  " << left << setw(13) << tokenTypeToString(TokenType(kind)) << right << setw(12) << kinds[kind]
+                 << fixed << setprecision(1) << setw(7) << 100.0 * kinds[kind] / tokens << "%\n"
+                 << defaultfloat;
+    cout.flush();
+    return session.diagnostics.empty() ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    // --packed lexes the whole file into a PackedTokens stream before
+    // parsing; the default streams tokens from the lexer as they are needed.
+    // --ast prints the syntax tree after a successful parse.
+    // --batch parses every file, directory or @list given, on --jobs N
+    // threads (all cores by default). --parallel splits a single large file
+    // across the --jobs threads instead. --edit OFFSET:LENGTH:TEXT (repeatable)
+    // loads the file as an IncrementalDocument and applies each edit to it.
+    // --server PATH answers parse requests on a Unix socket until killed, and
+    // --client PATH sends the inputs to such a server instead of parsing.
+    // --bench times the lexer and parser on a generated program instead (see
+    // parseBenchOption for its options; --emit prints the program).
+    // --complexity instead checks that adversarial inputs of growing size
+    // (--size sets the largest) take no more than linear time, and
+    // --parallel-check that --parallel matches a sequential parse on
+    // randomly damaged programs.
+    // --stats times each phase of parsing the file and prints statistics,
+    // --stats=json prints them as JSON instead of the usual output.
+    // --max-depth N reports nesting deeper than N as an error (0: no limit).
+    // --cache-dir DIR reuses results for unchanged sources (see ParseCache).
+    // --run compiles the program to bytecode and runs it; with --bench it
+    // times the VM on built-in loop-heavy programs instead. --opt compiles
+    // through the optimizing IR (see ir.h), whose passes --passes LIST picks
+    // (comma-separated, or none). --ir prints the optimized IR instead of
+    // running it, and --ir-stats also times lowering and each pass.
+    // --save-ast OUT writes the parsed program to OUT (see ast_format.h).
+    bool packed = false;
+    bool parallel = false;
+    vector<string> edits;
+    string server, client;
+    bool dumpAst = false;
+    bool batch = false;
+    bool bench = false;
+    bool complexity = false;
+    bool parallelCheck = false;
+    bool run = false;
+    bool optimize = false;
+    bool printIrOnly = false;
+    bool irStats = false;
+    string passes = DEFAULT_IR_PASSES;
+    BenchOptions benchOptions;
+    string stats;
+    size_t depthLimit = DEFAULT_DEPTH_LIMIT;
+    string cacheDir;
+    string astPath;
+    unsigned jobs = thread::hardware_concurrency();
+    vector<string> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        string_view arg = argv[i];
+        if (arg == "--packed")
+            packed = true;
+        else if (arg == "--ast")
+            dumpAst = true;
+        else if (arg == "--batch")
+            batch = true;
+        else if (arg == "--parallel")
+            parallel = true;
+        else if (arg == "--bench")
+            bench = true;
+        else if (arg == "--complexity")
+            complexity = true;
+        else if (arg == "--parallel-check")
+            parallelCheck = true;
+        else if (arg == "--run")
+            run = true;
+        else if (arg == "--opt")
+            optimize = true;
+        else if (arg == "--ir" || arg == "--ir-stats")
+        {
+            printIrOnly = true;
+            irStats = irStats || arg == "--ir-stats";
+        }
+        else if (arg == "--passes" && i + 1 < argc)
+            passes = argv[++i];
+        else if (arg == "--stats" || arg == "--stats=text" || arg == "--stats=json")
+            stats = arg == "--stats=json" ? "json" : "text";
+        else if (arg == "--edit" && i + 1 < argc)
+            edits.push_back(argv[++i]);
+        else if (arg == "--server" && i + 1 < argc)
+            server = argv[++i];
+        else if (arg == "--client" && i + 1 < argc)
+            client = argv[++i];
+        else if (arg == "--cache-dir" && i + 1 < argc)
+            cacheDir = argv[++i];
+        else if (arg == "--save-ast" && i + 1 < argc)
+            astPath = argv[++i];
+        else if (arg == "--max-depth" && i + 1 < argc)
+        {
+            // As for --jobs, the first character must be a digit; strtoull
+            // reports a number too big for it through errno
+            const char *limit = argv[++i];
+            char *end;
+            errno = 0;
+            unsigned long long value = strtoull(limit, &end, 10);
+            if (*limit < '0' || *limit > '9' || *end != '\0' || errno == ERANGE || value > SIZE_MAX)
+            {
+                cout << "Error: --max-depth takes a number of levels (0 for no limit), got " << limit << endl;
+                return 1;
+            }
+            depthLimit = size_t(value);
+        }
+        else if (arg == "--jobs" && i + 1 < argc)
+        {
+            // strtoul skips spaces and negates a leading minus, so the
+            // first character must be a digit
+            const char *count = argv[++i];
+            char *end;
+            unsigned long value = strtoul(count, &end, 10);
+            if (*count < '0' || *count > '9' || *end != '\0' || value == 0 || value > UINT32_MAX)
+            {
+                cout << "Error: --jobs takes a positive number of threads, got " << count << endl;
+                return 1;
+            }
+            jobs = unsigned(value);
+        }
+        else if (!parseBenchOption(argc, argv, i, benchOptions))
+            inputs.push_back(argv[i]);
+    }
+    if (depthLimit == 0)
+        depthLimit = SIZE_MAX;
+    if (complexity)
+        return runComplexityCheck(benchOptions);
+    if (parallelCheck)
+        return runParallelCheck(benchOptions, jobs);
+    IrPipeline pipeline;
+    string unknownPass;
+    if (!pipeline.select(passes, unknownPass))
+    {
+        cout << "Error: unknown pass " << unknownPass << endl;
+        return 1;
+    }
+    IrPipeline *optimizer = optimize ? &pipeline : nullptr;
+    if (bench)
+        return run ? runVmBenchmark(benchOptions, optimizer) : runBenchmark(benchOptions);
+    if (!server.empty())
+        return runServer(server, packed, depthLimit);
+    if (inputs.empty())
+    {
+        cout << "Provide a file" << endl;
+        return 1;
+    }
+    if (!client.empty())
+        return runClient(client, inputs);
+    unique_ptr<ParseCache> cache;
+    if (!cacheDir.empty())
+        cache = make_unique<ParseCache>(cacheDir, depthLimit);
+    if (batch)
+        return runBatch(inputs, jobs, packed, depthLimit, cache.get());
+    const char *path = inputs.back().c_str();
+    if (!stats.empty())
+        return runStats(path, stats == "json", depthLimit);
+
+    SourceFile file;
+    if (!file.open(path))
+    {
+        cout << "Error: Unable to open file " << path << endl;
+        return 1;
+    }
+
+    if (!edits.empty())
+        return runEdits(file.view(), edits, dumpAst);
+
+    ParseSession session;
+    session.depthLimit = depthLimit;
+    string_view src = file.view();
+    Stmt *program = nullptr;
+    if (cache != nullptr && cache->load(src, session))
+    {
+        if ((dumpAst || run || printIrOnly || !astPath.empty()) && session.diagnostics.empty())
+            program = session.parseTokens(src);
+    }
+    else
+    {
+        // Below about a megabyte the thread startup costs more than it saves
+        program = parallel && src.size() >= (1 << 20) && src.size() < UINT32_MAX
+                      ? session.parseParallel(src, jobs)
+                      : session.parse(src, packed || cache != nullptr);
+        if (cache != nullptr)
+            cache->store(src, session);
+    }
+    if (!session.diagnostics.empty())
+    {
+        session.report(cout);
+        return 1;
+    }
+    if (!astPath.empty() && !saveAst(astPath, src, program, session.symbols))
+        return 1;
+    if (printIrOnly)
+        return runIr(src, program, session, pipeline, irStats);
+    if (run)
+        return runProgram(src, program, session, optimizer);
+    cout << "Parsing completed successfully! No Syntax Error" << endl;
+    if (dumpAst)
+        dumpStmts<AgarSyntax>(program, cout);
+    return 0;
+}
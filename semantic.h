@@ -0,0 +1,283 @@
+#ifndef SEMANTIC_H
+#define SEMANTIC_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "frontend.h"
+
+// Semantic analysis over a parsed program: every variable must be declared
+// before it is used, and not twice in the same scope, and every expression
+// gets a type that must fit where it is used. The rules follow C for the
+// declarable types of data_types.cpp:
+//
+//   - int, float, double and char are numbers and convert to each other
+//     implicitly. Arithmetic on numbers gives the widest operand type
+//     (double, then float, then int; char counts as int).
+//   - string values only meet other strings: + concatenates, and
+//     comparisons compare.
+//   - bool comes from comparisons and true/false; && and || take bools.
+//   - A condition is a bool or a number.
+//   - A value can be assigned to a variable of its own type, or a number
+//     to any numeric variable.
+//
+// Blocks, and the bodies of if, while and for, open a scope. Scopes are
+// kept flat: since names are interned, the binding of every name lives in
+// one array indexed by symbol ID, and a declaration that shadows an outer
+// one logs the old binding, to be restored when its scope closes. Lookup,
+// declaration and closing a scope are each O(1) per name, with no hashing.
+enum ValueType : uint8_t
+{
+    V_ERROR, // type of an expression that already had an error reported
+    V_INT,
+    V_FLOAT,
+    V_DOUBLE,
+    V_CHAR,
+    V_BOOL,
+    V_STRING,
+};
+
+inline const char *valueTypeName(ValueType type)
+{
+    static const char *const names[] = {"<error>", "int", "float", "double", "char", "bool", "string"};
+    return names[type];
+}
+
+// Type a declaration keyword introduces
+inline ValueType declaredType(TokenType keyword)
+{
+    switch (keyword)
+    {
+    case T_INT:
+        return V_INT;
+    case T_FLOAT:
+        return V_FLOAT;
+    case T_DOUBLE:
+        return V_DOUBLE;
+    case T_CHAR:
+        return V_CHAR;
+    case T_BOOL:
+        return V_BOOL;
+    case T_STRING:
+        return V_STRING;
+    default:
+        return V_ERROR;
+    }
+}
+
+// Result type of each binary operator for each pair of operand types, V_ERROR
+// where the operator does not apply. Operators and operand types are both
+// data-dependent in a program, so a table lookup stands in for what would
+// otherwise be a few hard-to-predict branches per operator.
+struct BinaryTypeTable
+{
+    static constexpr size_t TYPES = V_STRING + 1;
+    ValueType table[256][TYPES][TYPES];
+    static constexpr bool numeric(ValueType type) { return type >= V_INT && type <= V_CHAR; }
+    constexpr BinaryTypeTable() : table()
+    {
+        for (size_t l = V_INT; l < TYPES; l++)
+        {
+            for (size_t r = V_INT; r < TYPES; r++)
+            {
+                ValueType lhs = ValueType(l), rhs = ValueType(r);
+                bool numbers = numeric(lhs) && numeric(rhs), strings = lhs == V_STRING && rhs == V_STRING;
+                // char takes part in arithmetic as int
+                ValueType wider = std::max(lhs == V_CHAR ? V_INT : lhs, rhs == V_CHAR ? V_INT : rhs);
+                for (TokenType op : {T_MINUS, T_MUL, T_DIV})
+                    table[op][l][r] = numbers ? wider : V_ERROR;
+                table[T_PLUS][l][r] = numbers ? wider : strings ? V_STRING : V_ERROR;
+                for (TokenType op : {T_LT, T_LE, T_GT})
+                    table[op][l][r] = numbers || strings ? V_BOOL : V_ERROR;
+                for (TokenType op : {T_EQ, T_NEQ})
+                    table[op][l][r] = numbers || lhs == rhs ? V_BOOL : V_ERROR;
+                for (TokenType op : {T_AND_OP, T_OR_OP})
+                    table[op][l][r] = lhs == V_BOOL && rhs == V_BOOL ? V_BOOL : V_ERROR;
+            }
+        }
+    }
+    constexpr ValueType of(TokenType op, ValueType lhs, ValueType rhs) const { return table[uint8_t(op)][lhs][rhs]; }
+};
+constexpr BinaryTypeTable binaryTypes;
+
+class TypeChecker
+{
+private:
+    struct Binding
+    {
+        ValueType type;
+        uint32_t depth; // scope depth of the declaration, 0 if none is visible
+    };
+    struct Shadowed
+    {
+        uint32_t symbol;
+        Binding previous;
+    };
+
+    std::string_view src; // the AST's names and numbers are views into it
+    Diagnostics &diagnostics;
+    std::vector<Binding> bindings; // by symbol ID
+    std::vector<Shadowed> undo;    // bindings replaced in the open scopes
+    std::vector<size_t> scopes;    // size of `undo` when each scope opened
+    std::vector<const Expr *> spine;
+
+    size_t offsetOf(std::string_view text) const { return text.data() - src.data(); }
+    // Offset of the leftmost operand of an expression, where its errors are reported
+    size_t offsetOf(const Expr *expr) const
+    {
+        while (expr->kind == E_BINARY)
+            expr = expr->lhs;
+        return offsetOf(expr->text);
+    }
+    static bool numeric(ValueType type) { return BinaryTypeTable::numeric(type); }
+
+    void openScope() { scopes.push_back(undo.size()); }
+    void closeScope()
+    {
+        for (size_t mark = scopes.back(); undo.size() > mark; undo.pop_back())
+            bindings[undo.back().symbol] = undo.back().previous;
+        scopes.pop_back();
+    }
+    void declare(const Stmt *stmt)
+    {
+        Binding &binding = bindings[stmt->symbol];
+        uint32_t depth = uint32_t(scopes.size());
+        if (binding.depth == depth)
+        {
+            diagnostics.report(offsetOf(stmt->name),
+                               "Semantic error: '" + std::string(stmt->name) + "' is already declared in this scope");
+            return;
+        }
+        undo.push_back(Shadowed{stmt->symbol, binding});
+        binding = Binding{declaredType(stmt->type), depth};
+    }
+    ValueType lookup(uint32_t symbol, std::string_view name)
+    {
+        const Binding &binding = bindings[symbol];
+        if (binding.depth == 0)
+        {
+            diagnostics.report(offsetOf(name), "Semantic error: '" + std::string(name) + "' is not declared");
+            return V_ERROR;
+        }
+        return binding.type;
+    }
+
+    ValueType leafType(const Expr *expr)
+    {
+        switch (expr->kind)
+        {
+        case E_ID:
+            return lookup(expr->symbol, expr->text);
+        case E_BOOL:
+            return V_BOOL;
+        default:
+            return expr->text.find('.') == std::string_view::npos ? V_INT : V_DOUBLE;
+        }
+    }
+    ValueType binaryType(const Expr *expr, ValueType lhs, ValueType rhs)
+    {
+        ValueType type = binaryTypes.of(expr->op, lhs, rhs);
+        if (type == V_ERROR && lhs != V_ERROR && rhs != V_ERROR)
+            diagnostics.report(offsetOf(expr), "Type error: " + tokenTypeToString(expr->op) + " cannot take " +
+                                                   valueTypeName(lhs) + " and " + valueTypeName(rhs));
+        return type;
+    }
+    // Operator chains are left-nested and can be as long as the input, so
+    // the left spine is walked with a loop; only right operands recurse,
+    // and those nest no deeper than the parser's depth limit allows.
+    ValueType typeOf(const Expr *expr)
+    {
+        size_t base = spine.size();
+        for (; expr->kind == E_BINARY; expr = expr->lhs)
+            spine.push_back(expr);
+        ValueType type = leafType(expr);
+        while (spine.size() > base)
+        {
+            const Expr *binary = spine.back();
+            spine.pop_back();
+            type = binaryType(binary, type, typeOf(binary->rhs));
+        }
+        return type;
+    }
+    void checkCondition(const Expr *expr)
+    {
+        ValueType type = typeOf(expr);
+        if (type != V_ERROR && type != V_BOOL && !numeric(type))
+            diagnostics.report(offsetOf(expr), std::string("Type error: a condition cannot be ") + valueTypeName(type));
+    }
+    void checkAssignment(const Stmt *stmt)
+    {
+        ValueType target = lookup(stmt->symbol, stmt->name);
+        ValueType value = typeOf(stmt->expr);
+        if (target != V_ERROR && value != V_ERROR && target != value && !(numeric(target) && numeric(value)))
+            diagnostics.report(offsetOf(stmt->name), std::string("Type error: cannot assign ") + valueTypeName(value) +
+                                                         " to '" + std::string(stmt->name) + "' of type " +
+                                                         valueTypeName(target));
+    }
+    // A body gets its own scope even when it is a single statement, as in C
+    void checkBody(const Stmt *body)
+    {
+        openScope();
+        checkList(body);
+        closeScope();
+    }
+    void checkList(const Stmt *stmt)
+    {
+        for (; stmt != nullptr; stmt = stmt->next)
+        {
+            switch (stmt->kind)
+            {
+            case S_DECL:
+                declare(stmt);
+                break;
+            case S_ASSIGN:
+                checkAssignment(stmt);
+                break;
+            case S_WHILE:
+                checkCondition(stmt->expr);
+                checkBody(stmt->body);
+                break;
+            case S_FOR:
+                checkAssignment(stmt->init);
+                checkCondition(stmt->expr);
+                checkAssignment(stmt->step);
+                checkBody(stmt->body);
+                break;
+            case S_IF:
+                checkCondition(stmt->expr);
+                checkBody(stmt->body);
+                if (stmt->elseBody != nullptr)
+                    checkBody(stmt->elseBody);
+                break;
+            case S_RETURN:
+            case S_PRINT:
+                typeOf(stmt->expr);
+                break;
+            case S_BREAK:
+            case S_CONTINUE:
+                break;
+            case S_BLOCK:
+                checkBody(stmt->body);
+                break;
+            }
+        }
+    }
+
+public:
+    // `src` is the source the program was parsed from and `symbols` the pool
+    // its names were interned in
+    TypeChecker(std::string_view src, const SymbolPool &symbols, Diagnostics &diagnostics)
+        : src(src), diagnostics(diagnostics), bindings(symbols.size(), Binding{V_ERROR, 0}) {}
+    // Checks a whole program, reporting problems to the diagnostics
+    void check(const Stmt *program)
+    {
+        openScope(); // the program's own scope, so no declaration has depth 0
+        checkList(program);
+        closeScope();
+    }
+};
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef SYMBOL_POOL_H
+#define SYMBOL_POOL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Interned identifiers. The lexer hands every identifier it sees to
+// intern(), which returns the same 32-bit ID for the same spelling; tokens
+// and AST nodes carry the ID, so names compare as integers and later passes
+// can index tables by them. Each distinct name is stored once, so memory
+// follows the number of distinct names rather than of occurrences.
+//
+// Lookup is an open-addressing table with linear probing, kept at most a
+// quarter full. Each slot holds the ID plus 32 bits of the name's hash, so
+// a probe only touches the name itself when the hashes agree. Names are
+// copied into blocks that never move, so name() views stay valid until
+// clear().
+class SymbolPool
+{
+private:
+    static constexpr size_t BLOCK_SIZE = 16 * 1024;
+    struct Slot
+    {
+        uint32_t hash;
+        uint32_t id; // ID + 1, 0 for an empty slot
+    };
+    std::vector<Slot> slots;
+    std::vector<std::string_view> names; // by ID
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char *free;
+    size_t left; // bytes left at free
+
+    static uint64_t load32(const char *p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    static uint64_t load64(const char *p)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    // 64x64 -> 128-bit multiply, folded back to 64 bits
+    static uint64_t mix(uint64_t a, uint64_t b)
+    {
+        unsigned __int128 product = (unsigned __int128)a * b;
+        return uint64_t(product) ^ uint64_t(product >> 64);
+    }
+    // Names of up to 16 bytes, nearly all of them, are read with at most
+    // four overlapping loads and no loop, so the branches do not depend on
+    // the exact length
+    static uint32_t hash(std::string_view name)
+    {
+        const uint64_t K0 = 0xA0761D6478BD642Full, K1 = 0xE7037ED1A0B428DBull;
+        const char *p = name.data();
+        size_t n = name.size();
+        uint64_t a, b, h = K0;
+        if (n <= 16)
+        {
+            if (n >= 4)
+            {
+                size_t skip = (n >> 3) << 2; // 0 for 4..7 bytes, 4 for 8..16
+                a = load32(p) << 32 | load32(p + skip);
+                b = load32(p + n - 4) << 32 | load32(p + n - 4 - skip);
+            }
+            else if (n > 0)
+            {
+                a = uint64_t((unsigned char)p[0]) << 16 | uint64_t((unsigned char)p[n >> 1]) << 8 |
+                    (unsigned char)p[n - 1];
+                b = 0;
+            }
+            else
+                a = b = 0;
+        }
+        else
+        {
+            for (; n > 16; p += 16, n -= 16)
+                h = mix(load64(p) ^ K1, load64(p + 8) ^ h);
+            a = load64(p + n - 16);
+            b = load64(p + n - 8);
+        }
+        return uint32_t(mix(K1 ^ name.size(), mix(a ^ K1, b ^ h)));
+    }
+    std::string_view copy(std::string_view name)
+    {
+        if (name.size() > left)
+        {
+            size_t size = std::max(name.size(), BLOCK_SIZE);
+            blocks.push_back(std::make_unique<char[]>(size));
+            free = blocks.back().get();
+            left = size;
+        }
+        memcpy(free, name.data(), name.size());
+        std::string_view stored(free, name.size());
+        free += name.size();
+        left -= name.size();
+        return stored;
+    }
+    void grow()
+    {
+        std::vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        size_t mask = slots.size() - 1;
+        for (const Slot &slot : old)
+        {
+            if (slot.id == 0)
+                continue;
+            size_t i = slot.hash & mask;
+            while (slots[i].id != 0)
+                i = (i + 1) & mask;
+            slots[i] = slot;
+        }
+    }
+
+public:
+    SymbolPool() : slots(256), free(nullptr), left(0) {}
+    SymbolPool(const SymbolPool &) = delete;
+    SymbolPool &operator=(const SymbolPool &) = delete;
+
+    // Returns the ID of `name`, adding it if it is new. IDs count up from 0
+    // in order of first appearance.
+    uint32_t intern(std::string_view name)
+    {
+        uint32_t hash = SymbolPool::hash(name);
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            Slot &slot = slots[i];
+            if (slot.id == 0)
+            {
+                uint32_t id = uint32_t(names.size());
+                names.push_back(copy(name));
+                slot = Slot{hash, id + 1};
+                if (names.size() * 4 > slots.size())
+                    grow();
+                return id;
+            }
+            if (slot.hash == hash && names[slot.id - 1] == name)
+                return slot.id - 1;
+        }
+    }
+    std::string_view name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+    // Forgets every name. Blocks beyond the first are released; the table
+    // keeps its size.
+    void clear()
+    {
+        std::fill(slots.begin(), slots.end(), Slot{0, 0});
+        names.clear();
+        if (blocks.size() > 1)
+            blocks.erase(blocks.begin() + 1, blocks.end());
+        free = blocks.empty() ? nullptr : blocks[0].get();
+        left = blocks.empty() ? 0 : BLOCK_SIZE;
+    }
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef SYNTAXES_H
+#define SYNTAXES_H
+
+#include "frontend.h"
+#include "keywords.h"
+
+// The syntax traits of the three front ends, for BasicLexer and BasicParser
+// in frontend.h. Each driver parses one of them; the fuzz target
+// (fuzz_frontend.cpp) runs all three.
+
+// parser.cpp: "agar" for if, loops, print, and the full set of comparison
+// and logical operators, over int variables only
+constexpr Keyword<TokenType> agarKeywords[] = {
+    {"int", T_INT},
+    {"agar", T_AGAR},
+    {"else", T_ELSE},
+    {"return", T_RETURN},
+    {"break", T_BREAK},
+    {"continue", T_CONTINUE},
+    {"true", T_TRUE},
+    {"false", T_FALSE},
+    {"print", T_PRINT},
+    {"while", T_WHILE},
+    {"for", T_FOR},
+};
+struct AgarSyntax
+{
+    static constexpr const char *name = "parser.cpp";
+    static constexpr KeywordTable keywords{agarKeywords};
+    static constexpr TokenType types[] = {T_INT};
+    static constexpr TokenType ifKeyword = T_AGAR;
+    static constexpr bool loops = true;
+    static constexpr bool decimals = false;
+    static constexpr bool comparisons = true;
+    static constexpr bool logical = true;
+    static constexpr bool booleans = false;
+};
+
+// data_types.cpp: declarations of six data types, assignments, if/else and
+// return, with decimal numbers and '>' as the only comparison
+constexpr Keyword<TokenType> dataTypesKeywords[] = {
+    {"int", T_INT},
+    {"float", T_FLOAT},
+    {"double", T_DOUBLE},
+    {"string", T_STRING},
+    {"bool", T_BOOL},
+    {"char", T_CHAR},
+    {"true", T_TRUE},
+    {"false", T_FALSE},
+    {"if", T_IF},
+    {"else", T_ELSE},
+    {"return", T_RETURN},
+};
+struct DataTypesSyntax
+{
+    static constexpr const char *name = "data_types.cpp";
+    static constexpr KeywordTable keywords{dataTypesKeywords};
+    static constexpr TokenType types[] = {T_INT, T_FLOAT, T_DOUBLE, T_STRING, T_BOOL, T_CHAR};
+    static constexpr TokenType ifKeyword = T_IF;
+    static constexpr bool loops = false;
+    static constexpr bool decimals = true;
+    static constexpr bool comparisons = false;
+    static constexpr bool logical = false;
+    static constexpr bool booleans = true;
+};
+
+// line_number.cpp: declarations of int variables, assignments, if/else and
+// return, with '>' as the only comparison
+constexpr Keyword<TokenType> lineNumberKeywords[] = {
+    {"int", T_INT},
+    {"if", T_IF},
+    {"else", T_ELSE},
+    {"return", T_RETURN},
+};
+struct LineNumberSyntax
+{
+    static constexpr const char *name = "line_number.cpp";
+    static constexpr KeywordTable keywords{lineNumberKeywords};
+    static constexpr TokenType types[] = {T_INT};
+    static constexpr TokenType ifKeyword = T_IF;
+    static constexpr bool loops = false;
+    static constexpr bool decimals = false;
+    static constexpr bool comparisons = false;
+    static constexpr bool logical = false;
+    static constexpr bool booleans = false;
+};
+
+#endif
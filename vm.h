@@ -0,0 +1,578 @@
+#ifndef VM_H
+#define VM_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "frontend.h"
+
+// Bytecode compiler and virtual machine for the programs parser.cpp parses.
+//
+// The VM is a stack machine over 64-bit integers. Each instruction is one
+// 32-bit word, the opcode in the low 8 bits and an operand in the high 24:
+// a constant's index, a variable's slot or a jump target. Variables live in
+// slots numbered by their interned symbol ID, so the VM never looks a name
+// up; every slot starts at 0, and a declaration sets its slot back to 0.
+// Arithmetic wraps around, division truncates toward zero, and comparisons
+// and && and || give 0 or 1. && and || only evaluate their right operand
+// when they need it.
+//
+// Conditions compile to a compare-and-branch instruction where they can,
+// so a loop test like `i < n` costs one dispatch instead of two.
+enum Opcode : uint8_t
+{
+    OP_CONST, // push constants[operand]
+    OP_LOAD,  // push slots[operand]
+    OP_STORE, // pop into slots[operand]
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    // Comparisons; the compare-and-branch forms below follow the same order
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_EQ,
+    OP_NEQ,
+    // Pop two values and jump to operand unless the comparison holds
+    OP_BRANCH_LT,
+    OP_BRANCH_LE,
+    OP_BRANCH_GT,
+    OP_BRANCH_EQ,
+    OP_BRANCH_NEQ,
+    OP_AND,           // jump to operand leaving the top if it is 0, else pop it
+    OP_OR,            // jump to operand with the top made 1 if it is not 0, else pop it
+    OP_TO_BOOL,       // replace the top with 0 or 1
+    OP_JUMP,          // jump to operand
+    OP_JUMP_IF_FALSE, // pop, and jump to operand if the value was 0
+    OP_PRINT,         // pop and print
+    OP_RETURN,        // pop and stop with that value
+    OP_HALT,          // stop with value 0
+};
+
+struct Bytecode
+{
+    static constexpr uint32_t MAX_OPERAND = (1u << 24) - 1;
+
+    std::vector<uint32_t> code;
+    std::vector<uint32_t> offsets; // source offset of each instruction, for runtime errors
+    std::vector<int64_t> constants;
+    uint32_t slots = 0; // number of variable slots
+    uint32_t stack = 0; // deepest the operand stack gets
+
+    static Opcode opcode(uint32_t word) { return Opcode(word & 0xFF); }
+    static uint32_t operand(uint32_t word) { return word >> 8; }
+};
+
+// Value of a number literal, false if it does not fit in an int64_t
+inline bool literalValue(std::string_view text, int64_t &value)
+{
+    uint64_t result = 0;
+    for (char c : text)
+    {
+        if (result > (uint64_t(INT64_MAX) - (c - '0')) / 10)
+            return false;
+        result = result * 10 + (c - '0');
+    }
+    value = int64_t(result);
+    return true;
+}
+
+// The error for a literal that literalValue rejects. A long literal is shown
+// by its first and last digits, so the message stays one line however many
+// digits the source has.
+inline std::string outOfRangeError(std::string_view text)
+{
+    const size_t SHOWN = 20; // digits kept at each end
+    std::string number = text.size() <= 2 * SHOWN ? std::string(text)
+                                                   : std::string(text.substr(0, SHOWN)) + "..." +
+                                                         std::string(text.substr(text.size() - SHOWN));
+    return "Compile error: number " + number + " is out of range";
+}
+
+// Appends instructions to a Bytecode, keeping track of how deep the operand
+// stack gets and of which positions are jump targets. Shared by the
+// compilers from the AST (below) and from the IR (ir.h).
+class BytecodeBuilder
+{
+private:
+    size_t lastLabel = SIZE_MAX; // last position a jump was aimed at
+    uint32_t depth = 0;          // operand stack depth at the current position
+    bool tooLarge = false;
+
+    static int stackEffect(Opcode op)
+    {
+        switch (op)
+        {
+        case OP_CONST:
+        case OP_LOAD:
+            return 1;
+        case OP_TO_BOOL:
+        case OP_JUMP:
+        case OP_HALT:
+            return 0;
+        case OP_BRANCH_LT:
+        case OP_BRANCH_LE:
+        case OP_BRANCH_GT:
+        case OP_BRANCH_EQ:
+        case OP_BRANCH_NEQ:
+            return -2;
+        default:
+            return -1;
+        }
+    }
+
+public:
+    Bytecode bytecode;
+    uint32_t offset = 0; // source offset charged to instructions emitted now
+
+    // Appends an instruction, returning its position
+    size_t emit(Opcode op, size_t operand = 0)
+    {
+        if (operand > Bytecode::MAX_OPERAND || bytecode.code.size() >= Bytecode::MAX_OPERAND)
+            tooLarge = true;
+        depth += stackEffect(op);
+        bytecode.stack = std::max(bytecode.stack, depth);
+        bytecode.code.push_back(uint32_t(op) | uint32_t(operand) << 8);
+        bytecode.offsets.push_back(offset);
+        return bytecode.code.size() - 1;
+    }
+    // The current position, as the target of a jump
+    size_t label()
+    {
+        lastLabel = bytecode.code.size();
+        return lastLabel;
+    }
+    void patch(size_t jump, size_t target)
+    {
+        uint32_t &word = bytecode.code[jump];
+        word = (word & 0xFF) | uint32_t(target) << 8;
+    }
+    size_t constant(int64_t value)
+    {
+        bytecode.constants.push_back(value);
+        return bytecode.constants.size() - 1;
+    }
+    // Appends a jump taken when the value on top of the stack is 0,
+    // returning it to be patched. A comparison just before the jump is
+    // fused with it, unless something jumps in between them.
+    size_t branchIfFalse()
+    {
+        Opcode last = bytecode.code.empty() ? OP_HALT : Bytecode::opcode(bytecode.code.back());
+        if (last >= OP_LT && last <= OP_NEQ && lastLabel != bytecode.code.size())
+        {
+            bytecode.code.back() = uint32_t(last - OP_LT + OP_BRANCH_LT);
+            depth--;
+            return bytecode.code.size() - 1;
+        }
+        return emit(OP_JUMP_IF_FALSE);
+    }
+    // Ends the program with OP_HALT and hands the bytecode over
+    Bytecode finish(Diagnostics &diagnostics)
+    {
+        emit(OP_HALT);
+        if (tooLarge || bytecode.slots > Bytecode::MAX_OPERAND)
+            diagnostics.report(0, "Compile error: program too large for the bytecode");
+        return std::move(bytecode);
+    }
+};
+
+// Compiles a parsed program to Bytecode. The statement tree is walked
+// recursively, as deep as the parser's depth limit lets it nest; operator
+// chains are walked down their left spine with a loop, like TypeChecker
+// does, since those can be as long as the input.
+class BytecodeCompiler
+{
+private:
+    struct Loop
+    {
+        size_t continueTarget;          // SIZE_MAX until known (the step of a for loop)
+        std::vector<size_t> breaks;    // jumps to patch to the loop's end
+        std::vector<size_t> continues; // jumps to patch to continueTarget
+    };
+
+    std::string_view src; // the AST's names and numbers are views into it
+    Diagnostics &diagnostics;
+    BytecodeBuilder out;
+    std::vector<Loop> loops;
+    std::vector<const Expr *> spine;
+    uint32_t zero = 0; // constant index of 0
+
+    size_t offsetOf(std::string_view text) const { return text.data() - src.data(); }
+
+    void leaf(const Expr *expr)
+    {
+        out.offset = uint32_t(offsetOf(expr->text));
+        int64_t value = 0;
+        if (expr->kind == E_ID)
+        {
+            out.emit(OP_LOAD, expr->symbol);
+            return;
+        }
+        if (expr->kind == E_BOOL)
+            value = expr->text == "true";
+        else if (!literalValue(expr->text, value))
+            diagnostics.report(out.offset, outOfRangeError(expr->text));
+        out.emit(OP_CONST, out.constant(value));
+    }
+    static Opcode opcodeFor(TokenType op)
+    {
+        switch (op)
+        {
+        case T_PLUS:
+            return OP_ADD;
+        case T_MINUS:
+            return OP_SUB;
+        case T_MUL:
+            return OP_MUL;
+        case T_DIV:
+            return OP_DIV;
+        case T_LT:
+            return OP_LT;
+        case T_LE:
+            return OP_LE;
+        case T_GT:
+            return OP_GT;
+        case T_EQ:
+            return OP_EQ;
+        default:
+            return OP_NEQ;
+        }
+    }
+    void expression(const Expr *expr)
+    {
+        size_t base = spine.size();
+        for (; expr->kind == E_BINARY; expr = expr->lhs)
+            spine.push_back(expr);
+        // Every operator on the spine reports at its leftmost operand
+        uint32_t leftmost = uint32_t(offsetOf(expr->text));
+        leaf(expr);
+        while (spine.size() > base)
+        {
+            const Expr *binary = spine.back();
+            spine.pop_back();
+            if (binary->op == T_AND_OP || binary->op == T_OR_OP)
+            {
+                size_t skip = out.emit(binary->op == T_AND_OP ? OP_AND : OP_OR);
+                expression(binary->rhs);
+                out.emit(OP_TO_BOOL);
+                out.patch(skip, out.label());
+            }
+            else
+            {
+                expression(binary->rhs);
+                out.offset = leftmost;
+                out.emit(opcodeFor(binary->op));
+            }
+        }
+    }
+    // Compiles a condition and a jump taken when it is false, returning the
+    // jump to be patched
+    size_t condition(const Expr *expr)
+    {
+        expression(expr);
+        return out.branchIfFalse();
+    }
+
+    // Compiles a loop body. continueTarget is SIZE_MAX when it is the code
+    // right after the body, as for the step of a for loop.
+    void loopBody(const Stmt *body, size_t continueTarget)
+    {
+        loops.push_back(Loop{continueTarget, {}, {}});
+        statements(body);
+        if (loops.back().continueTarget == SIZE_MAX)
+            loops.back().continueTarget = out.label();
+    }
+    void endLoop(size_t exit)
+    {
+        size_t end = out.label();
+        out.patch(exit, end);
+        for (size_t jump : loops.back().breaks)
+            out.patch(jump, end);
+        for (size_t jump : loops.back().continues)
+            out.patch(jump, loops.back().continueTarget);
+        loops.pop_back();
+    }
+    void statements(const Stmt *stmt)
+    {
+        for (; stmt != nullptr; stmt = stmt->next)
+            statement(stmt);
+    }
+    void statement(const Stmt *stmt)
+    {
+        switch (stmt->kind)
+        {
+        case S_DECL:
+            out.offset = uint32_t(offsetOf(stmt->name));
+            out.emit(OP_CONST, zero);
+            out.emit(OP_STORE, stmt->symbol);
+            break;
+        case S_ASSIGN:
+            expression(stmt->expr);
+            out.offset = uint32_t(offsetOf(stmt->name));
+            out.emit(OP_STORE, stmt->symbol);
+            break;
+        case S_WHILE:
+        {
+            size_t top = out.label();
+            size_t exit = condition(stmt->expr);
+            loopBody(stmt->body, top);
+            out.emit(OP_JUMP, top);
+            endLoop(exit);
+            break;
+        }
+        case S_FOR:
+        {
+            statement(stmt->init);
+            size_t top = out.label();
+            size_t exit = condition(stmt->expr);
+            loopBody(stmt->body, SIZE_MAX);
+            statement(stmt->step);
+            out.emit(OP_JUMP, top);
+            endLoop(exit);
+            break;
+        }
+        case S_IF:
+        {
+            size_t skip = condition(stmt->expr);
+            statements(stmt->body);
+            if (stmt->elseBody != nullptr)
+            {
+                size_t end = out.emit(OP_JUMP);
+                out.patch(skip, out.label());
+                statements(stmt->elseBody);
+                out.patch(end, out.label());
+            }
+            else
+                out.patch(skip, out.label());
+            break;
+        }
+        case S_RETURN:
+        case S_PRINT:
+            expression(stmt->expr);
+            out.emit(stmt->kind == S_RETURN ? OP_RETURN : OP_PRINT);
+            break;
+        case S_BREAK:
+        case S_CONTINUE:
+            out.offset = uint32_t(offsetOf(stmt->name));
+            if (loops.empty())
+                diagnostics.report(out.offset, "Compile error: " + std::string(stmt->name) + " outside a loop");
+            else if (stmt->kind == S_BREAK)
+                loops.back().breaks.push_back(out.emit(OP_JUMP));
+            else if (loops.back().continueTarget != SIZE_MAX)
+                out.emit(OP_JUMP, loops.back().continueTarget);
+            else
+                loops.back().continues.push_back(out.emit(OP_JUMP));
+            break;
+        case S_BLOCK:
+            statements(stmt->body);
+            break;
+        }
+    }
+
+public:
+    // `src` is the source the program was parsed from and `symbols` the pool
+    // its names were interned in
+    BytecodeCompiler(std::string_view src, const SymbolPool &symbols, Diagnostics &diagnostics)
+        : src(src), diagnostics(diagnostics)
+    {
+        out.bytecode.slots = uint32_t(symbols.size());
+        zero = uint32_t(out.constant(0));
+    }
+    // Compiles a whole program; the result is only meant to be run if no
+    // errors were reported
+    Bytecode compile(const Stmt *program)
+    {
+        statements(program);
+        return out.finish(diagnostics);
+    }
+};
+
+// Where the compiler supports it (GCC and Clang), each instruction jumps
+// straight to the next one's handler through a table of label addresses,
+// so every handler has its own indirect branch for the CPU to predict;
+// elsewhere a switch in a loop dispatches instead.
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+class VirtualMachine
+{
+private:
+    std::vector<int64_t> slots;
+    std::vector<int64_t> stack;
+    uint64_t executed = 0;
+
+public:
+    // Instructions the last run() executed
+    uint64_t instructions() const { return executed; }
+
+    // Runs a program from the start with every variable at 0, writing what
+    // it prints to `out`. Returns the value it returned (0 if it ran off the
+    // end); a runtime error is reported to `diagnostics` and stops it.
+    int64_t run(const Bytecode &bytecode, std::ostream &out, Diagnostics &diagnostics)
+    {
+        slots.assign(bytecode.slots, 0);
+        stack.resize(bytecode.stack + 1);
+        const uint32_t *code = bytecode.code.data();
+        const uint32_t *pc = code;
+        const int64_t *constants = bytecode.constants.data();
+        int64_t *vars = slots.data();
+        int64_t *sp = stack.data(); // one past the top
+        uint64_t steps = 0;
+        uint32_t word;
+        int64_t result = 0;
+
+#ifdef VM_COMPUTED_GOTO
+        // In Opcode order
+        static const void *const handlers[] = {
+            &&L_OP_CONST, &&L_OP_LOAD, &&L_OP_STORE, &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV,
+            &&L_OP_LT, &&L_OP_LE, &&L_OP_GT, &&L_OP_EQ, &&L_OP_NEQ,
+            &&L_OP_BRANCH_LT, &&L_OP_BRANCH_LE, &&L_OP_BRANCH_GT, &&L_OP_BRANCH_EQ, &&L_OP_BRANCH_NEQ,
+            &&L_OP_AND, &&L_OP_OR, &&L_OP_TO_BOOL, &&L_OP_JUMP, &&L_OP_JUMP_IF_FALSE,
+            &&L_OP_PRINT, &&L_OP_RETURN, &&L_OP_HALT};
+        static_assert(sizeof(handlers) / sizeof(handlers[0]) == OP_HALT + 1, "a handler for every opcode");
+#define VM_CASE(op) L_##op:
+#define VM_NEXT()                                      \
+    do                                                 \
+    {                                                  \
+        word = *pc++;                                  \
+        steps++;                                       \
+        goto *handlers[Bytecode::opcode(word)];        \
+    } while (0)
+        VM_NEXT();
+#else
+#define VM_CASE(op) case op:
+#define VM_NEXT() continue
+        for (;;)
+        {
+            word = *pc++;
+            steps++;
+            switch (Bytecode::opcode(word))
+            {
+#endif
+#define VM_BINARY(op, expression) \
+    VM_CASE(op)                   \
+    {                             \
+        int64_t b = *--sp;        \
+        int64_t a = sp[-1];       \
+        sp[-1] = (expression);    \
+        VM_NEXT();                \
+    }
+#define VM_BRANCH(op, comparison)                  \
+    VM_CASE(op)                                    \
+    {                                              \
+        sp -= 2;                                   \
+        if (!(sp[0] comparison sp[1]))             \
+            pc = code + Bytecode::operand(word);   \
+        VM_NEXT();                                 \
+    }
+
+        VM_CASE(OP_CONST)
+        {
+            *sp++ = constants[Bytecode::operand(word)];
+            VM_NEXT();
+        }
+        VM_CASE(OP_LOAD)
+        {
+            *sp++ = vars[Bytecode::operand(word)];
+            VM_NEXT();
+        }
+        VM_CASE(OP_STORE)
+        {
+            vars[Bytecode::operand(word)] = *--sp;
+            VM_NEXT();
+        }
+        // Through uint64_t so that overflow wraps instead of being undefined
+        VM_BINARY(OP_ADD, int64_t(uint64_t(a) + uint64_t(b)))
+        VM_BINARY(OP_SUB, int64_t(uint64_t(a) - uint64_t(b)))
+        VM_BINARY(OP_MUL, int64_t(uint64_t(a) * uint64_t(b)))
+        VM_CASE(OP_DIV)
+        {
+            int64_t b = *--sp;
+            int64_t a = sp[-1];
+            if (b == 0)
+            {
+                diagnostics.report(bytecode.offsets[pc - 1 - code], "Runtime error: division by zero");
+                goto done;
+            }
+            sp[-1] = b == -1 ? int64_t(0 - uint64_t(a)) : a / b; // INT64_MIN / -1 wraps too
+            VM_NEXT();
+        }
+        VM_BINARY(OP_LT, a < b)
+        VM_BINARY(OP_LE, a <= b)
+        VM_BINARY(OP_GT, a > b)
+        VM_BINARY(OP_EQ, a == b)
+        VM_BINARY(OP_NEQ, a != b)
+        VM_BRANCH(OP_BRANCH_LT, <)
+        VM_BRANCH(OP_BRANCH_LE, <=)
+        VM_BRANCH(OP_BRANCH_GT, >)
+        VM_BRANCH(OP_BRANCH_EQ, ==)
+        VM_BRANCH(OP_BRANCH_NEQ, !=)
+        VM_CASE(OP_AND)
+        {
+            if (sp[-1] == 0)
+                pc = code + Bytecode::operand(word);
+            else
+                sp--;
+            VM_NEXT();
+        }
+        VM_CASE(OP_OR)
+        {
+            if (sp[-1] != 0)
+            {
+                sp[-1] = 1;
+                pc = code + Bytecode::operand(word);
+            }
+            else
+                sp--;
+            VM_NEXT();
+        }
+        VM_CASE(OP_TO_BOOL)
+        {
+            sp[-1] = sp[-1] != 0;
+            VM_NEXT();
+        }
+        VM_CASE(OP_JUMP)
+        {
+            pc = code + Bytecode::operand(word);
+            VM_NEXT();
+        }
+        VM_CASE(OP_JUMP_IF_FALSE)
+        {
+            if (*--sp == 0)
+                pc = code + Bytecode::operand(word);
+            VM_NEXT();
+        }
+        VM_CASE(OP_PRINT)
+        {
+            out << *--sp << '\n';
+            VM_NEXT();
+        }
+        VM_CASE(OP_RETURN)
+        {
+            result = *--sp;
+            goto done;
+        }
+        VM_CASE(OP_HALT)
+        {
+            goto done;
+        }
+#ifndef VM_COMPUTED_GOTO
+            }
+        }
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_BINARY
+#undef VM_BRANCH
+    done:
+        executed = steps;
+        return result;
+    }
+};
+
+#endif